@@ -0,0 +1,524 @@
+#include <iostream>
+#include <coroutine>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <optional>
+#include <exception>
+#include <string>
+#include <stdexcept>
+
+#include "../thread-pool/thread_pool.h"
+#include "../message-queue/message_queue.h"
+
+using namespace std;
+
+// ================== Task<T> =====================
+// Lazily started coroutine. Nothing runs until the Task is co_awaited, the
+// awaiting coroutine is then resumed by symmetric transfer once the Task
+// finishes, so chains of Tasks neither grow the stack nor bounce through the
+// pool. Where a Task runs is decided by what it awaits: resume_on(), timers
+// and queue pops all resume the coroutine on a ThreadPool worker.
+template <typename T = void>
+class Task;
+
+struct TaskPromiseBase
+{
+    coroutine_handle<> continuation = noop_coroutine();
+    exception_ptr error;
+
+    suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> h) noexcept
+        {
+            return h.promise().continuation;
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception()
+    {
+        error = current_exception();
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename V>
+    void return_value(V &&v)
+    {
+        value.emplace(std::forward<V>(v));
+    }
+
+    T result()
+    {
+        if (error)
+            rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result()
+    {
+        if (error)
+            rethrow_exception(error);
+    }
+};
+
+template <typename T>
+class Task
+{
+public:
+    using promise_type = TaskPromise<T>;
+    using Handle = coroutine_handle<promise_type>;
+
+    explicit Task(Handle h) : m_handle(h) {}
+
+    ~Task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    Task(Task &&other) noexcept : m_handle(other.m_handle)
+    {
+        other.m_handle = nullptr;
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = other.m_handle;
+            other.m_handle = nullptr;
+        }
+        return *this;
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            Handle handle;
+
+            bool await_ready() noexcept { return handle.done(); }
+
+            coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept
+            {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{m_handle};
+    }
+
+private:
+    Handle m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// ================== Scheduling =====================
+// `co_await resume_on(pool)` suspends and continues on one of pool's workers.
+struct ResumeOn
+{
+    ThreadPool &pool;
+
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(coroutine_handle<> h)
+    {
+        pool.submit_task([h]
+                         { h.resume(); });
+    }
+
+    void await_resume() noexcept {}
+};
+
+inline ResumeOn resume_on(ThreadPool &pool)
+{
+    return ResumeOn{pool};
+}
+
+// Fire-and-forget coroutine that frees its own frame when it finishes.
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+};
+
+// Starts `task` on the pool without waiting for it. Exceptions escaping a
+// spawned task terminate the program, handle them inside the task.
+inline DetachedTask spawn(ThreadPool &pool, Task<void> task)
+{
+    co_await resume_on(pool);
+    co_await std::move(task);
+}
+
+template <typename T>
+struct SyncWaitState
+{
+    atomic<int> done{0};
+    optional<conditional_t<is_void_v<T>, monostate, T>> value;
+    exception_ptr error;
+};
+
+template <typename T>
+DetachedTask run_and_signal(ThreadPool &pool, Task<T> task, SyncWaitState<T> *state)
+{
+    co_await resume_on(pool);
+    try
+    {
+        if constexpr (is_void_v<T>)
+        {
+            co_await std::move(task);
+            state->value.emplace();
+        }
+        else
+        {
+            state->value.emplace(co_await std::move(task));
+        }
+    }
+    catch (...)
+    {
+        state->error = current_exception();
+    }
+    state->done.store(1, memory_order_release);
+    state->done.notify_all();
+}
+
+// Runs `task` on the pool and blocks the calling thread until it finishes.
+// Meant for main() and tests, never call it from a pool worker.
+template <typename T>
+T sync_wait(ThreadPool &pool, Task<T> task)
+{
+    SyncWaitState<T> state;
+    run_and_signal(pool, std::move(task), &state);
+    state.done.wait(0, memory_order_acquire);
+    if (state.error)
+        rethrow_exception(state.error);
+    if constexpr (!is_void_v<T>)
+        return std::move(*state.value);
+}
+
+// ================== Timers =====================
+// One thread sleeping until the earliest deadline. Expired coroutines are
+// handed back to their pool, so the timer thread never runs user code.
+// Coroutines still sleeping when the service is destroyed are never resumed.
+class TimerService
+{
+public:
+    using Clock = chrono::steady_clock;
+
+    TimerService() : m_stop(false)
+    {
+        m_thread = thread([this]
+                          { this->run(); });
+    }
+
+    ~TimerService()
+    {
+        {
+            lock_guard<mutex> guard(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    struct SleepAwaiter
+    {
+        TimerService &timers;
+        ThreadPool &pool;
+        Clock::time_point when;
+
+        bool await_ready() const { return when <= Clock::now(); }
+
+        void await_suspend(coroutine_handle<> h)
+        {
+            timers.schedule(when, h, &pool);
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    SleepAwaiter sleep_until(ThreadPool &pool, Clock::time_point when)
+    {
+        return SleepAwaiter{*this, pool, when};
+    }
+
+    SleepAwaiter sleep_for(ThreadPool &pool, Clock::duration d)
+    {
+        return SleepAwaiter{*this, pool, Clock::now() + d};
+    }
+
+private:
+    struct Timer
+    {
+        Clock::time_point when;
+        coroutine_handle<> handle;
+        ThreadPool *pool;
+
+        bool operator>(const Timer &other) const { return when > other.when; }
+    };
+
+    void schedule(Clock::time_point when, coroutine_handle<> h, ThreadPool *pool)
+    {
+        bool earliest;
+        {
+            lock_guard<mutex> guard(m_mutex);
+            earliest = m_timers.empty() || when < m_timers.top().when;
+            m_timers.push({when, h, pool});
+        }
+        if (earliest)
+            m_cv.notify_one();
+    }
+
+    void run()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_timers.empty())
+            {
+                m_cv.wait(lock);
+                continue;
+            }
+
+            auto next = m_timers.top();
+            if (next.when > Clock::now())
+            {
+                m_cv.wait_until(lock, next.when);
+                continue;
+            }
+
+            m_timers.pop();
+            lock.unlock();
+            next.pool->submit_task([h = next.handle]
+                                   { h.resume(); });
+            lock.lock();
+        }
+    }
+
+    priority_queue<Timer, vector<Timer>, greater<Timer>> m_timers;
+    mutex m_mutex;
+    condition_variable m_cv;
+    bool m_stop;
+    thread m_thread;
+};
+
+// ================== MessageQueue awaitable =====================
+// `co_await async_pop(queue, pool)` takes the next message without holding a
+// thread: if the queue is empty the coroutine parks itself as a PopWaiter and
+// the pushing thread hands the item over and reschedules it on the pool. If
+// the queue is closed the coroutine is resumed with a std::runtime_error, the
+// same thing a blocking pop() throws.
+template <typename T>
+class PopAwaiter : public MessageQueue<T>::PopWaiter
+{
+public:
+    PopAwaiter(MessageQueue<T> &queue, ThreadPool &pool) : m_queue(queue), m_pool(pool) {}
+
+    bool await_ready() noexcept { return false; }
+
+    bool await_suspend(coroutine_handle<> h)
+    {
+        m_handle = h;
+        // once parked, the producer may resume us at any moment, so `this`
+        // must not be touched after pop_or_wait() returns false
+        return !m_queue.pop_or_wait(m_item, this);
+    }
+
+    T await_resume()
+    {
+        if (m_closed)
+            throw runtime_error("MessageQueue: closed");
+        return std::move(m_item);
+    }
+
+    void deliver(T item) override
+    {
+        m_item = std::move(item);
+        m_pool.submit_task([h = m_handle]
+                           { h.resume(); });
+    }
+
+    void closed() override
+    {
+        m_closed = true;
+        m_pool.submit_task([h = m_handle]
+                           { h.resume(); });
+    }
+
+private:
+    MessageQueue<T> &m_queue;
+    ThreadPool &m_pool;
+    coroutine_handle<> m_handle;
+    T m_item{};
+    bool m_closed = false;
+};
+
+template <typename T>
+PopAwaiter<T> async_pop(MessageQueue<T> &queue, ThreadPool &pool)
+{
+    return PopAwaiter<T>(queue, pool);
+}
+
+// ================== Demo: request pipeline =====================
+Task<int> lookup_price(TimerService &timers, ThreadPool &pool, int item)
+{
+    co_await timers.sleep_for(pool, chrono::milliseconds(20)); // pretend backend call
+    co_return item * 100;
+}
+
+Task<void> handle_requests(MessageQueue<int> &requests, TimerService &timers, ThreadPool &pool, int count, latch &done)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int item = co_await async_pop(requests, pool);
+        int price = co_await lookup_price(timers, pool, item);
+        cout << "request " << item << " -> price " << price << " on thread " << this_thread::get_id() << endl;
+    }
+    done.count_down();
+}
+
+// ================== Benchmark =====================
+// `consumers` consumers share one MessageQueue and each takes `perConsumer`
+// messages. As coroutines every consumer is a suspended frame parked on the
+// queue; in the thread-per-consumer model every consumer is an OS thread
+// blocked in pop().
+Task<void> coroutine_consumer(MessageQueue<int> &queue, ThreadPool &pool, int perConsumer, atomic<long> &sum, latch &done)
+{
+    for (int i = 0; i < perConsumer; i++)
+        sum.fetch_add(co_await async_pop(queue, pool), memory_order_relaxed);
+    done.count_down();
+}
+
+double bench_coroutines(int consumers, int perConsumer, unsigned workers)
+{
+    ThreadPool pool(workers);
+    MessageQueue<int> queue;
+    atomic<long> sum{0};
+    latch done(consumers);
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int c = 0; c < consumers; c++)
+        spawn(pool, coroutine_consumer(queue, pool, perConsumer, sum, done));
+    for (long i = 0; i < static_cast<long>(consumers) * perConsumer; i++)
+        queue.push(1);
+    done.wait();
+    auto end = chrono::high_resolution_clock::now();
+
+    if (sum != static_cast<long>(consumers) * perConsumer)
+        cerr << "coroutine benchmark lost messages\n";
+    return chrono::duration<double>(end - start).count();
+}
+
+double bench_threads(int consumers, int perConsumer)
+{
+    MessageQueue<int> queue;
+    atomic<long> sum{0};
+    vector<thread> threads;
+    threads.reserve(consumers);
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int c = 0; c < consumers; c++)
+        threads.emplace_back([&queue, &sum, perConsumer]
+                             {
+                                 for (int i = 0; i < perConsumer; i++)
+                                     sum.fetch_add(queue.pop(), memory_order_relaxed); });
+    for (long i = 0; i < static_cast<long>(consumers) * perConsumer; i++)
+        queue.push(1);
+    for (auto &t : threads)
+        t.join();
+    auto end = chrono::high_resolution_clock::now();
+
+    if (sum != static_cast<long>(consumers) * perConsumer)
+        cerr << "thread benchmark lost messages\n";
+    return chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned workers = max(thread::hardware_concurrency(), 2u);
+
+    {
+        ThreadPool pool(workers);
+        TimerService timers;
+        MessageQueue<int> requests;
+        latch done(2);
+
+        spawn(pool, handle_requests(requests, timers, pool, 3, done));
+        spawn(pool, handle_requests(requests, timers, pool, 3, done));
+        for (int i = 1; i <= 6; i++)
+            requests.push(i);
+        done.wait();
+
+        auto answer = sync_wait(pool, lookup_price(timers, pool, 42));
+        cout << "sync_wait result: " << answer << endl;
+    }
+
+    // 100k coroutines fit in memory easily; the same number of OS threads
+    // usually does not, so the thread model is capped (second argument).
+    int consumers = argc > 1 ? stoi(argv[1]) : 100'000;
+    int threadConsumers = argc > 2 ? stoi(argv[2]) : 2'000;
+    constexpr int perConsumer = 10;
+
+    double coroSeconds = bench_coroutines(consumers, perConsumer, workers);
+    cout << "\n"
+         << consumers << " coroutine consumers on " << workers << " workers: "
+         << coroSeconds << " s (" << consumers * perConsumer / coroSeconds << " msgs/sec)\n";
+
+    double threadSeconds = bench_threads(threadConsumers, perConsumer);
+    cout << threadConsumers << " thread-per-consumer consumers: "
+         << threadSeconds << " s (" << threadConsumers * perConsumer / threadSeconds << " msgs/sec)\n";
+
+    return 0;
+}
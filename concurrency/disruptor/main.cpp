@@ -0,0 +1,368 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <string>
+#include <initializer_list>
+#include <stdexcept>
+#include <bit>
+#include <cstdint>
+
+#include "../ring-buffer/ring_buffer.h"
+
+using namespace std;
+
+// ================== Multicast ring =====================
+// One ring shared by every consumer, in the style of the LMAX Disruptor.
+// Producers claim sequence numbers, fill the slot in place and publish it.
+// Each consumer tracks the last sequence it has processed in its own
+// sequence, so nothing is copied per consumer. A consumer registered with
+// dependencies only sees a sequence once all of them have processed it,
+// which builds pipelines ("strategy after risk") on a single ring. Producers
+// never lap the slowest consumer.
+//
+// Any number of producers may claim concurrently: claims are a fetch_add on
+// one counter, and each slot records the lap it was last published in, so
+// consumers can tell a published slot from one that is merely claimed.
+//
+// Handlers get the item by non-const reference so a stage can annotate it
+// for the stages that depend on it; a stage must not write fields that a
+// consumer running in parallel with it reads.
+template <typename T, size_t SIZE>
+class MulticastRing
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be power of two");
+
+public:
+    using Sequence = int64_t;
+    static constexpr size_t kMaxConsumers = 16;
+
+    MulticastRing()
+    {
+        for (auto &lap : m_published)
+            lap.store(-1, memory_order_relaxed);
+    }
+
+    MulticastRing(const MulticastRing &) = delete;
+    MulticastRing &operator=(const MulticastRing &) = delete;
+
+    // Registers a consumer that sees each item after every consumer in
+    // `after` has processed it. Call before anything is published; returns
+    // the id passed to poll().
+    size_t add_consumer(initializer_list<size_t> after = {})
+    {
+        if (m_numConsumers == kMaxConsumers)
+            throw runtime_error("MulticastRing: too many consumers");
+        auto &consumer = m_consumers[m_numConsumers];
+        for (size_t dep : after)
+        {
+            if (dep >= m_numConsumers)
+                throw runtime_error("MulticastRing: unknown dependency");
+            consumer.deps[consumer.numDeps++] = dep;
+        }
+        return m_numConsumers++;
+    }
+
+    // ---- producer side ----
+
+    // Claims n consecutive sequences and returns the first, waiting while
+    // that would overwrite items the slowest consumer has not processed.
+    // Throws if n is larger than the ring, which could never be granted.
+    Sequence claim(size_t n = 1)
+    {
+        if (n > SIZE)
+            throw runtime_error("MulticastRing: claim larger than the ring");
+        Sequence first = m_claimed.fetch_add(n, memory_order_relaxed);
+        Sequence wrapPoint = first + static_cast<Sequence>(n) - 1 - static_cast<Sequence>(SIZE);
+        // acquire/release: a producer that trusts another's cached value
+        // must also see the consumers' reads of those slots as done
+        if (wrapPoint > m_gatingCache.load(memory_order_acquire))
+        {
+            Sequence slowest;
+            YieldWait().wait([&]
+                             { return wrapPoint <= (slowest = slowest_consumer()); });
+            m_gatingCache.store(slowest, memory_order_release);
+        }
+        return first;
+    }
+
+    T &operator[](Sequence seq)
+    {
+        return m_slots[seq & MASK];
+    }
+
+    void publish(Sequence first, size_t n = 1)
+    {
+        for (Sequence seq = first; seq < first + static_cast<Sequence>(n); seq++)
+            m_published[seq & MASK].store(lap(seq), memory_order_release);
+    }
+
+    // claim + fill + publish for a single item
+    template <typename Fill>
+    void publish_with(Fill &&fill)
+    {
+        Sequence seq = claim();
+        fill(m_slots[seq & MASK], seq);
+        publish(seq);
+    }
+
+    // ---- consumer side, one thread per consumer id ----
+
+    // Hands every item that is ready for `consumer` (up to maxBatch) to
+    // handler(item, seq, endOfBatch), then marks them processed. Returns
+    // how many were handled, 0 if nothing was ready.
+    template <typename Handler>
+    size_t poll(size_t id, Handler &&handler, size_t maxBatch = SIZE)
+    {
+        auto &consumer = m_consumers[id];
+        Sequence next = consumer.sequence.load(memory_order_relaxed) + 1;
+        Sequence available = consumer.cachedBarrier;
+        if (available < next)
+            available = consumer.cachedBarrier = barrier(consumer, next);
+        if (available < next)
+            return 0;
+
+        available = min(available, next + static_cast<Sequence>(maxBatch) - 1);
+        for (Sequence seq = next; seq <= available; seq++)
+            handler(m_slots[seq & MASK], seq, seq == available);
+        consumer.sequence.store(available, memory_order_release);
+        return static_cast<size_t>(available - next + 1);
+    }
+
+    Sequence processed(size_t id) const
+    {
+        return m_consumers[id].sequence.load(memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t MASK = SIZE - 1;
+    static constexpr int kLapShift = bit_width(SIZE) - 1;
+
+    struct alignas(64) ConsumerState
+    {
+        atomic<Sequence> sequence{-1}; // last processed, written by its thread only
+        Sequence cachedBarrier = -1;   // consumer thread's last view of its barrier
+        size_t deps[kMaxConsumers];
+        size_t numDeps = 0;
+    };
+
+    static int32_t lap(Sequence seq)
+    {
+        return static_cast<int32_t>(seq >> kLapShift);
+    }
+
+    // Highest sequence `consumer` may process: the lowest sequence processed
+    // by its dependencies, or for a consumer without any the end of the run
+    // of published slots starting at `next`.
+    Sequence barrier(const ConsumerState &consumer, Sequence next) const
+    {
+        if (consumer.numDeps > 0)
+        {
+            Sequence lowest = consumer.sequence.load(memory_order_relaxed) + static_cast<Sequence>(SIZE);
+            for (size_t i = 0; i < consumer.numDeps; i++)
+                lowest = min(lowest, m_consumers[consumer.deps[i]].sequence.load(memory_order_acquire));
+            return lowest;
+        }
+
+        Sequence claimed = m_claimed.load(memory_order_relaxed) - 1;
+        Sequence seq = next;
+        while (seq <= claimed && m_published[seq & MASK].load(memory_order_acquire) == lap(seq))
+            seq++;
+        return seq - 1;
+    }
+
+    Sequence slowest_consumer() const
+    {
+        Sequence lowest = m_claimed.load(memory_order_relaxed);
+        for (size_t i = 0; i < m_numConsumers; i++)
+            lowest = min(lowest, m_consumers[i].sequence.load(memory_order_acquire));
+        return lowest;
+    }
+
+    T m_slots[SIZE];
+    atomic<int32_t> m_published[SIZE]; // lap each slot was last published in
+    ConsumerState m_consumers[kMaxConsumers];
+    size_t m_numConsumers = 0;
+
+    alignas(64) atomic<Sequence> m_claimed{0};       // next sequence to claim
+    alignas(64) atomic<Sequence> m_gatingCache{-1}; // producers' last view of the slowest consumer
+};
+
+// ================== Benchmark =====================
+// A market data feed fanned out to a logger, a risk check and a strategy
+// that only trades on ticks risk has approved. The per-consumer design
+// copies every tick into one SPSC RingBuffer per consumer and has risk
+// forward approved ticks into the strategy's ring; the multicast design
+// runs all three off one ring, with the strategy depending on risk.
+struct Tick
+{
+    int64_t seq;
+    double price;
+    int64_t quantity;
+    bool approved;
+};
+
+struct Results
+{
+    int64_t logged = 0;
+    int64_t approved = 0;
+    int64_t traded = 0;
+    bool inOrder = true;
+};
+
+bool risk_check(const Tick &tick)
+{
+    return tick.quantity * tick.price < 50'000;
+}
+
+Tick make_tick(int64_t i)
+{
+    return Tick{i, 100.0 + i % 7, i % 1000, false};
+}
+
+constexpr size_t kRingSize = 1 << 14;
+
+double per_consumer_rings(int64_t total, Results &results)
+{
+    auto logRing = make_unique<RingBuffer<Tick, kRingSize, YieldWait>>();
+    auto riskRing = make_unique<RingBuffer<Tick, kRingSize, YieldWait>>();
+    auto strategyRing = make_unique<RingBuffer<Tick, kRingSize, YieldWait>>();
+
+    auto start = chrono::high_resolution_clock::now();
+    thread logger([&]
+                  {
+                      Tick tick{};
+                      for (int64_t i = 0; i < total; i++)
+                      {
+                          logRing->pop_wait(tick);
+                          results.inOrder &= tick.seq == i;
+                          results.logged++;
+                      } });
+    thread risk([&]
+                {
+                    Tick tick{};
+                    for (int64_t i = 0; i < total; i++)
+                    {
+                        riskRing->pop_wait(tick);
+                        tick.approved = risk_check(tick);
+                        results.approved += tick.approved;
+                        strategyRing->push_wait(tick);
+                    } });
+    thread strategy([&]
+                    {
+                        Tick tick{};
+                        for (int64_t i = 0; i < total; i++)
+                        {
+                            strategyRing->pop_wait(tick);
+                            results.traded += tick.approved;
+                        } });
+
+    for (int64_t i = 0; i < total; i++)
+    {
+        Tick tick = make_tick(i);
+        logRing->push_wait(tick);
+        riskRing->push_wait(tick);
+    }
+    logger.join();
+    risk.join();
+    strategy.join();
+    auto end = chrono::high_resolution_clock::now();
+    return total / chrono::duration<double>(end - start).count();
+}
+
+// Runs one consumer of `ring` until it has handled `total` items.
+template <typename Ring, typename Handler>
+thread consumer_thread(Ring &ring, size_t id, int64_t total, Handler handler)
+{
+    return thread([&ring, id, total, handler]() mutable
+                  {
+                      while (ring.processed(id) < total - 1)
+                      {
+                          if (ring.poll(id, handler) == 0)
+                              YieldWait().wait([&]
+                                               { return ring.poll(id, handler) > 0 || ring.processed(id) >= total - 1; });
+                      } });
+}
+
+double multicast_ring(int64_t total, int producers, size_t batch, Results &results)
+{
+    auto ring = make_unique<MulticastRing<Tick, kRingSize>>();
+    size_t logger = ring->add_consumer();
+    size_t risk = ring->add_consumer();
+    size_t strategy = ring->add_consumer({risk});
+
+    // per-producer order: tick.seq counts up within each producer and the
+    // producer is seq % producers, so track the last tick seen from each
+    vector<int64_t> lastSeen(producers, -1);
+
+    auto start = chrono::high_resolution_clock::now();
+    vector<thread> threads;
+    threads.push_back(consumer_thread(*ring, logger, total, [&](Tick &tick, int64_t, bool)
+                                      {
+                                          auto &last = lastSeen[tick.seq % producers];
+                                          results.inOrder &= tick.seq > last;
+                                          last = tick.seq;
+                                          results.logged++; }));
+    threads.push_back(consumer_thread(*ring, risk, total, [&](Tick &tick, int64_t, bool)
+                                      {
+                                          tick.approved = risk_check(tick);
+                                          results.approved += tick.approved; }));
+    threads.push_back(consumer_thread(*ring, strategy, total, [&](Tick &tick, int64_t, bool)
+                                      { results.traded += tick.approved; }));
+
+    // producers claim a batch of slots at a time, so the shared claim counter
+    // is touched once per batch rather than once per tick
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&ring, p, producers, total, batch]
+                             {
+                                 for (int64_t i = p; i < total;)
+                                 {
+                                     size_t n = min<int64_t>(batch, (total - i + producers - 1) / producers);
+                                     auto first = ring->claim(n);
+                                     for (size_t k = 0; k < n; k++, i += producers)
+                                         (*ring)[first + k] = make_tick(i);
+                                     ring->publish(first, n);
+                                 } });
+    }
+    for (auto &t : threads)
+        t.join();
+    auto end = chrono::high_resolution_clock::now();
+    return total / chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int64_t total = argc > 1 ? stoll(argv[1]) : 10'000'000;
+
+    int64_t expectedApproved = 0;
+    for (int64_t i = 0; i < total; i++)
+        expectedApproved += risk_check(make_tick(i));
+
+    auto check = [&](const Results &r)
+    {
+        return r.inOrder && r.logged == total && r.approved == expectedApproved && r.traded == expectedApproved
+                   ? "ok"
+                   : "MISMATCH";
+    };
+
+    cout << "Fanning " << total << " ticks out to logger, risk and strategy (after risk)\n";
+    Results copies;
+    double copiesRate = per_consumer_rings(total, copies);
+    cout << "ring per consumer:        " << copiesRate << " ticks/s  " << check(copies) << "\n";
+
+    for (int producers : {1, 2, 4})
+    {
+        for (size_t batch : {1, 64})
+        {
+            Results shared;
+            double sharedRate = multicast_ring(total, producers, batch, shared);
+            cout << "multicast ring, " << producers << " producer" << (producers > 1 ? "s" : " ")
+                 << ", batch " << batch << (batch < 10 ? ": " : ":") << "  " << sharedRate << " ticks/s  " << check(shared) << "\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,290 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_set>
+#include <cstdint>
+#include <fcntl.h>
+
+#include "server.h"
+
+using namespace std;
+
+// ================== Thread per connection (baseline) =====================
+// What we used before: an accept thread gives every connection a thread of
+// its own, which runs one request at a time and writes its reply before
+// parsing the next, so a pipelining client still costs a send per request,
+// and every idle client parks a thread.
+class ThreadPerConnectionServer
+{
+public:
+    ThreadPerConnectionServer(KVStore &store, const string &address)
+        : m_store(store), m_listener(kvnet::listen_on(address)), m_address(kvnet::local_address(m_listener))
+    {
+        // accept() blocks; shutdown() in the destructor wakes it
+        ::fcntl(m_listener.get(), F_SETFL, ::fcntl(m_listener.get(), F_GETFL) & ~O_NONBLOCK);
+        m_acceptor = thread([this]
+                            { accept_loop(); });
+    }
+
+    ~ThreadPerConnectionServer()
+    {
+        ::shutdown(m_listener.get(), SHUT_RDWR);
+        m_acceptor.join();
+        {
+            lock_guard<mutex> guard(m_mutex);
+            for (int fd : m_open)
+                ::shutdown(fd, SHUT_RDWR);
+        }
+        for (auto &t : m_threads)
+            t.join();
+    }
+
+    const string &address() const
+    {
+        return m_address;
+    }
+
+private:
+    void accept_loop()
+    {
+        while (true)
+        {
+            int fd = ::accept4(m_listener.get(), nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return;
+            }
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            lock_guard<mutex> guard(m_mutex);
+            m_open.insert(fd);
+            m_threads.emplace_back([this, fd]
+                                   { serve(fd); });
+        }
+    }
+
+    void serve(int fd)
+    {
+        vector<char> input(64 << 10);
+        size_t size = 0;
+        vector<string_view> args;
+        ReplyQueue replies;
+        bool open = true;
+        while (open)
+        {
+            ssize_t n = ::recv(fd, input.data() + size, input.size() - size, 0);
+            if (n <= 0)
+                break;
+            size += n;
+            size_t pos = 0, used = 0;
+            resp::Parse parsed;
+            while ((parsed = resp::parse_command(input.data() + pos, size - pos, args, used)) == resp::Parse::Complete)
+            {
+                execute_command(m_store, args, replies);
+                open = replies.flush(fd); // blocking: sends it all
+                pos += used;
+            }
+            open = open && parsed != resp::Parse::Error;
+            memmove(input.data(), input.data() + pos, size - pos);
+            size -= pos;
+            if (size == input.size())
+                input.resize(input.size() * 2);
+        }
+        lock_guard<mutex> guard(m_mutex);
+        m_open.erase(fd);
+        ::close(fd);
+    }
+
+    KVStore &m_store;
+    kvnet::Socket m_listener;
+    string m_address;
+    thread m_acceptor;
+    mutex m_mutex;
+    unordered_set<int> m_open;
+    vector<thread> m_threads;
+};
+
+// ================== Load generator =====================
+struct LoadResult
+{
+    double opsPerSec;
+    double p50us;
+    double p99us;
+};
+
+// `connections` clients, each with its own thread and socket, send batches
+// of `pipeline` requests, 90% GET and 10% SET of 100 byte values on `keys`
+// keys, for `duration`, reading every reply of a batch before sending the
+// next. A request's latency is the round trip of its batch.
+LoadResult run_load(const string &address, int connections, int pipeline, chrono::milliseconds duration, int keys)
+{
+    atomic<uint64_t> total{0};
+    mutex samplesMutex;
+    vector<double> samples;
+    vector<thread> clients;
+    auto deadline = chrono::steady_clock::now() + duration;
+    for (int c = 0; c < connections; c++)
+    {
+        clients.emplace_back([&, c]
+                             {
+                                 auto socket = kvnet::connect_to(address);
+                                 uint64_t rng = 0x9E3779B97F4A7C15ull * (c + 1), done = 0;
+                                 string batch, value(100, 'v');
+                                 vector<char> in(64 << 10);
+                                 vector<double> local;
+                                 while (chrono::steady_clock::now() < deadline)
+                                 {
+                                     batch.clear();
+                                     for (int k = 0; k < pipeline; k++)
+                                     {
+                                         rng ^= rng << 13;
+                                         rng ^= rng >> 7;
+                                         rng ^= rng << 17;
+                                         string key = "key:" + to_string(rng % keys);
+                                         if ((rng >> 32) % 10)
+                                             resp::append_command(batch, {"GET", key});
+                                         else
+                                             resp::append_command(batch, {"SET", key, value});
+                                     }
+
+                                     auto start = chrono::steady_clock::now();
+                                     for (size_t sent = 0; sent < batch.size();)
+                                     {
+                                         ssize_t n = ::send(socket.get(), batch.data() + sent, batch.size() - sent, MSG_NOSIGNAL);
+                                         if (n <= 0)
+                                             throw kvnet::error("send");
+                                         sent += n;
+                                     }
+                                     size_t have = 0;
+                                     bool error = false;
+                                     for (int replies = 0; replies < pipeline;)
+                                     {
+                                         if (have == in.size())
+                                             in.resize(in.size() * 2);
+                                         ssize_t n = ::recv(socket.get(), in.data() + have, in.size() - have, 0);
+                                         if (n <= 0)
+                                             throw kvnet::error("recv");
+                                         have += n;
+                                         size_t pos = 0, len;
+                                         while (replies < pipeline && (len = resp::reply_length(in.data() + pos, have - pos, error)))
+                                         {
+                                             pos += len;
+                                             replies++;
+                                         }
+                                         memmove(in.data(), in.data() + pos, have - pos);
+                                         have -= pos;
+                                     }
+                                     if (error)
+                                         throw runtime_error("server replied with an error");
+                                     local.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+                                     done += pipeline;
+                                 }
+                                 total.fetch_add(done);
+                                 lock_guard<mutex> guard(samplesMutex);
+                                 samples.insert(samples.end(), local.begin(), local.end()); });
+    }
+    auto start = chrono::steady_clock::now();
+    for (auto &c : clients)
+        c.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p)
+    {
+        return samples.empty() ? 0.0 : samples[min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+    };
+    return {total.load() / seconds, percentile(0.5), percentile(0.99)};
+}
+
+// Sends a few pipelined requests in one write and prints the raw replies.
+void demo(const string &address)
+{
+    auto socket = kvnet::connect_to(address);
+    string batch;
+    resp::append_command(batch, {"SET", "greeting", "hello"});
+    resp::append_command(batch, {"INCRBY", "visits", "41"});
+    resp::append_command(batch, {"INCR", "visits"});
+    resp::append_command(batch, {"MGET", "greeting", "visits", "missing"});
+    resp::append_command(batch, {"RANGE", "a", "z", "COUNT", "1"});
+    resp::append_command(batch, {"FLY"});
+    ::send(socket.get(), batch.data(), batch.size(), MSG_NOSIGNAL);
+
+    string out;
+    char buf[4096];
+    bool error = false;
+    for (size_t replies = 0, pos = 0; replies < 6;)
+    {
+        ssize_t n = ::recv(socket.get(), buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        out.append(buf, n);
+        while (replies < 6)
+        {
+            size_t len = resp::reply_length(out.data() + pos, out.size() - pos, error);
+            if (!len)
+                break;
+            pos += len;
+            replies++;
+        }
+    }
+    for (char c : out)
+        cout << (c == '\r' ? "\\r" : c == '\n' ? "\\n  " : string(1, c));
+    cout << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    int connections = argc > 1 ? stoi(argv[1]) : 8;
+    auto duration = chrono::milliseconds(argc > 2 ? stoi(argv[2]) : 1000);
+    constexpr int keys = 100'000;
+
+    KVStore store(64, KeyIndex::Ordered);
+    vector<pair<string, string>> fill;
+    for (int i = 0; i < keys; i++)
+        fill.push_back({"key:" + to_string(i), string(100, 'v')});
+    store.MultiSet(fill);
+
+    string socketPath = (filesystem::temp_directory_path() / "kvserver-bench.sock").string();
+    {
+        KVServer server(store, "unix:" + socketPath);
+        cout << "pipelined requests and their replies:\n  ";
+        demo(server.address());
+    }
+
+    cout << "\n"
+         << connections << " connections, 90% GET / 10% SET, " << thread::hardware_concurrency()
+         << " event loops\n";
+    cout << "transport  pipeline  server             ops/s       p50 us   p99 us  replies/send\n";
+    for (string transport : {"tcp", "unix"})
+    {
+        string address = transport == "tcp" ? "127.0.0.1:0" : "unix:" + socketPath;
+        for (int pipeline : {1, 16, 128})
+        {
+            LoadResult threaded, reactor;
+            double perSend;
+            {
+                ThreadPerConnectionServer server(store, address);
+                threaded = run_load(server.address(), connections, pipeline, duration, keys);
+            }
+            {
+                KVServer server(store, address);
+                reactor = run_load(server.address(), connections, pipeline, duration, keys);
+                perSend = static_cast<double>(server.requests()) / max<uint64_t>(server.sends(), 1);
+            }
+            cout << transport << "\t   " << pipeline << "\t     thread/conn\t" << threaded.opsPerSec << "\t    "
+                 << threaded.p50us << "\t     " << threaded.p99us << "\t    1\n";
+            cout << transport << "\t   " << pipeline << "\t     epoll reactor\t" << reactor.opsPerSec << "\t    "
+                 << reactor.p50us << "\t     " << reactor.p99us << "\t    " << perSend << "\n";
+        }
+    }
+    filesystem::remove(socketPath);
+    return 0;
+}
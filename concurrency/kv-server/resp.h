@@ -0,0 +1,319 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <climits>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "../kv-store/kv_store.h"
+
+// ================== Wire protocol =====================
+// A subset of RESP, the Redis protocol, so redis-cli and redis-benchmark
+// can talk to the server. A request is an array of bulk strings:
+//
+//   *<argc>\r\n  then, per argument,  $<length>\r\n<bytes>\r\n
+//
+// and a reply is one of +<status>\r\n, -<error>\r\n, :<integer>\r\n,
+// $<length>\r\n<bytes>\r\n, $-1\r\n for nil, or *<count>\r\n followed by
+// that many replies. Requests may be pipelined: a client can send any number
+// before reading the replies, which come back in order.
+namespace resp
+{
+    constexpr size_t kMaxArgs = 1 << 20;
+    constexpr size_t kMaxBulk = 512 << 20;
+
+    enum class Parse
+    {
+        Complete,
+        Incomplete,
+        Error,
+    };
+
+    // Reads "<integer>\r\n" at `p`, moving `p` past it.
+    inline Parse parse_line(const char *&p, const char *end, int64_t &value)
+    {
+        const char *cr = static_cast<const char *>(std::memchr(p, '\r', end - p));
+        if (!cr)
+            return end - p > 21 ? Parse::Error : Parse::Incomplete; // longer than any int64
+        if (cr + 1 == end)
+            return Parse::Incomplete;
+        auto [last, ec] = std::from_chars(p, cr, value);
+        if (ec != std::errc() || last != cr || cr[1] != '\n')
+            return Parse::Error;
+        p = cr + 2;
+        return Parse::Complete;
+    }
+
+    // Parses the request at the front of [data, data + size). When Complete,
+    // `args` views its arguments inside `data` and `used` is its length.
+    inline Parse parse_command(const char *data, size_t size, std::vector<std::string_view> &args, size_t &used)
+    {
+        const char *p = data, *end = data + size;
+        if (p == end)
+            return Parse::Incomplete;
+        if (*p++ != '*')
+            return Parse::Error;
+        int64_t argc;
+        if (Parse r = parse_line(p, end, argc); r != Parse::Complete)
+            return r;
+        if (argc < 1 || static_cast<uint64_t>(argc) > kMaxArgs)
+            return Parse::Error;
+
+        args.clear();
+        for (int64_t i = 0; i < argc; i++)
+        {
+            if (p == end)
+                return Parse::Incomplete;
+            if (*p++ != '$')
+                return Parse::Error;
+            int64_t len;
+            if (Parse r = parse_line(p, end, len); r != Parse::Complete)
+                return r;
+            if (len < 0 || static_cast<uint64_t>(len) > kMaxBulk)
+                return Parse::Error;
+            if (end - p < len + 2)
+                return Parse::Incomplete;
+            if (p[len] != '\r' || p[len + 1] != '\n')
+                return Parse::Error;
+            args.emplace_back(p, len);
+            p += len + 2;
+        }
+        used = p - data;
+        return Parse::Complete;
+    }
+
+    // The length of the reply at the front of [data, data + size), 0 if it
+    // is not all there yet. Sets `error` for a -error reply, or for bytes
+    // that are not a reply at all, in which case the length is meaningless.
+    inline size_t reply_length(const char *data, size_t size, bool &error)
+    {
+        const char *p = data, *end = data + size;
+        if (p == end)
+            return 0;
+        char type = *p++;
+        if (type == '+' || type == '-' || type == ':')
+        {
+            const char *lf = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!lf)
+                return 0;
+            error = error || type == '-';
+            return lf + 1 - data;
+        }
+        int64_t n;
+        Parse r = parse_line(p, end, n);
+        if (r == Parse::Incomplete)
+            return 0;
+        if (r == Parse::Error || (type != '$' && type != '*'))
+        {
+            error = true;
+            return size;
+        }
+        if (type == '$')
+        {
+            if (n < 0)
+                return p - data;
+            return end - p < n + 2 ? 0 : p + n + 2 - data;
+        }
+        for (int64_t i = 0; i < n; i++)
+        {
+            size_t len = reply_length(p, end - p, error);
+            if (!len)
+                return 0;
+            p += len;
+        }
+        return p - data;
+    }
+
+    // Case-insensitive comparison with an upper-case keyword.
+    inline bool is_keyword(std::string_view arg, std::string_view keyword)
+    {
+        return arg.size() == keyword.size() &&
+               std::equal(keyword.begin(), keyword.end(), arg.begin(), [](char k, char a)
+                          { return k == (a & ~0x20); });
+    }
+
+    inline void append_command(std::string &out, std::initializer_list<std::string_view> args)
+    {
+        out += '*';
+        out += std::to_string(args.size());
+        out += "\r\n";
+        for (auto arg : args)
+        {
+            out += '$';
+            out += std::to_string(arg.size());
+            out += "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+    }
+}
+
+// Replies waiting to be written to one connection, in order.
+//
+// Small replies are encoded into one buffer. A value of kCopyLimit bytes or
+// more is not copied: the queue keeps its KVStore::Value handle and points
+// an iovec at the stored bytes, so a large GET goes from the store to the
+// socket with no copy in user space. flush() hands everything queued to the
+// kernel with one vectored send per kMaxIov pieces, so replies to a whole
+// pipeline of requests go out in a single system call.
+class ReplyQueue
+{
+public:
+    static constexpr size_t kCopyLimit = 4096;
+    static constexpr size_t kMaxIov = IOV_MAX;
+
+    void status(std::string_view text)
+    {
+        line('+', text);
+    }
+
+    void error(std::string_view text)
+    {
+        line('-', text);
+    }
+
+    void integer(int64_t value)
+    {
+        line(':', std::to_string(value));
+    }
+
+    void nil()
+    {
+        append("$-1\r\n");
+    }
+
+    // The next `count` replies are the elements.
+    void array(size_t count)
+    {
+        line('*', std::to_string(count));
+    }
+
+    void bulk(std::string_view bytes)
+    {
+        line('$', std::to_string(bytes.size()));
+        append(bytes);
+        append("\r\n");
+    }
+
+    // nil for an empty handle, as KVStore::Get returns for an absent key
+    void bulk(const KVStore::Value &value)
+    {
+        if (value.size() < kCopyLimit)
+        {
+            if (value.empty())
+                nil();
+            else
+                bulk(value.view());
+            return;
+        }
+        line('$', std::to_string(value.size()));
+        m_pieces.push_back({0, value.size(), value});
+        append("\r\n");
+    }
+
+    bool empty() const
+    {
+        return m_pieces.empty();
+    }
+
+    // Sends as much as the socket takes without blocking. Returns false if
+    // the connection failed; what is left stays queued otherwise.
+    bool flush(int fd)
+    {
+        while (m_next < m_pieces.size())
+        {
+            iovec iov[kMaxIov];
+            size_t count = 0;
+            for (size_t i = m_next; i < m_pieces.size() && count < kMaxIov; i++)
+            {
+                size_t skip = i == m_next ? m_skip : 0;
+                iov[count++] = {const_cast<char *>(bytes(m_pieces[i]) + skip), m_pieces[i].size - skip};
+            }
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            // writev, but without SIGPIPE if the client has gone
+            ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            for (size_t left = sent; left;)
+            {
+                size_t rest = m_pieces[m_next].size - m_skip;
+                if (left < rest)
+                {
+                    m_skip += left;
+                    break;
+                }
+                left -= rest;
+                m_next++;
+                m_skip = 0;
+            }
+            if (static_cast<size_t>(sent) < total(iov, count))
+                return true; // the socket buffer is full
+        }
+        clear();
+        return true;
+    }
+
+private:
+    // A run of m_buffer, or the bytes of a held value.
+    struct Piece
+    {
+        size_t offset;
+        size_t size;
+        KVStore::Value value;
+    };
+
+    const char *bytes(const Piece &piece) const
+    {
+        return piece.value.size() ? piece.value.data() : m_buffer.data() + piece.offset;
+    }
+
+    static size_t total(const iovec *iov, size_t count)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++)
+            n += iov[i].iov_len;
+        return n;
+    }
+
+    void line(char type, std::string_view text)
+    {
+        append(std::string_view(&type, 1));
+        append(text);
+        append("\r\n");
+    }
+
+    // Extends the last buffer piece, or starts one after a held value.
+    void append(std::string_view bytes)
+    {
+        if (m_pieces.empty() || m_pieces.back().value.size())
+            m_pieces.push_back({m_buffer.size(), 0, {}});
+        m_buffer.append(bytes);
+        m_pieces.back().size += bytes.size();
+    }
+
+    void clear()
+    {
+        m_buffer.clear();
+        m_pieces.clear();
+        m_next = m_skip = 0;
+    }
+
+    std::string m_buffer;
+    std::vector<Piece> m_pieces;
+    size_t m_next = 0; // first piece not fully sent
+    size_t m_skip = 0; // bytes of it already sent
+};
@@ -0,0 +1,582 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "resp.h"
+
+// ================== Sockets =====================
+// Addresses are "host:port" for TCP or "unix:<path>" for a Unix domain
+// socket.
+namespace kvnet
+{
+    // Owns a file descriptor and closes it.
+    class Socket
+    {
+    public:
+        Socket() = default;
+
+        explicit Socket(int fd) : m_fd(fd) {}
+
+        Socket(Socket &&other) noexcept : m_fd(std::exchange(other.m_fd, -1)) {}
+
+        Socket &operator=(Socket &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                m_fd = std::exchange(other.m_fd, -1);
+            }
+            return *this;
+        }
+
+        Socket(const Socket &) = delete;
+        Socket &operator=(const Socket &) = delete;
+
+        ~Socket()
+        {
+            reset();
+        }
+
+        int get() const
+        {
+            return m_fd;
+        }
+
+        void reset()
+        {
+            if (m_fd >= 0)
+                ::close(m_fd);
+            m_fd = -1;
+        }
+
+    private:
+        int m_fd = -1;
+    };
+
+    inline std::runtime_error error(const std::string &what)
+    {
+        return std::runtime_error(what + " failed: " + strerror(errno));
+    }
+
+    // Fills `storage` for `address` and returns its length.
+    inline socklen_t resolve(const std::string &address, sockaddr_storage &storage)
+    {
+        storage = {};
+        if (address.starts_with("unix:"))
+        {
+            auto &un = reinterpret_cast<sockaddr_un &>(storage);
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(un.sun_path))
+                throw std::runtime_error("bad socket path: " + path);
+            un.sun_family = AF_UNIX;
+            std::memcpy(un.sun_path, path.c_str(), path.size() + 1);
+            return sizeof(sockaddr_un);
+        }
+        auto colon = address.rfind(':');
+        if (colon == std::string::npos)
+            throw std::runtime_error("bad address: " + address);
+        addrinfo hints{}, *found = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int rc = ::getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &found);
+        if (rc != 0)
+            throw std::runtime_error("resolving " + address + " failed: " + gai_strerror(rc));
+        socklen_t len = found->ai_addrlen;
+        std::memcpy(&storage, found->ai_addr, len);
+        ::freeaddrinfo(found);
+        return len;
+    }
+
+    // A non-blocking socket listening on `address`. A stale Unix socket
+    // file at the path is replaced.
+    inline Socket listen_on(const std::string &address, int backlog = 1024)
+    {
+        sockaddr_storage storage;
+        socklen_t len = resolve(address, storage);
+        Socket socket(::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        if (socket.get() < 0)
+            throw error("socket");
+        if (storage.ss_family == AF_UNIX)
+            ::unlink(reinterpret_cast<sockaddr_un &>(storage).sun_path);
+        int on = 1;
+        ::setsockopt(socket.get(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (::bind(socket.get(), reinterpret_cast<sockaddr *>(&storage), len) != 0)
+            throw error("bind(" + address + ")");
+        if (::listen(socket.get(), backlog) != 0)
+            throw error("listen(" + address + ")");
+        return socket;
+    }
+
+    // The address a listening socket ended up on, e.g. with the port the
+    // kernel picked for port 0.
+    inline std::string local_address(const Socket &socket)
+    {
+        sockaddr_storage storage;
+        socklen_t len = sizeof(storage);
+        if (::getsockname(socket.get(), reinterpret_cast<sockaddr *>(&storage), &len) != 0)
+            throw error("getsockname");
+        if (storage.ss_family == AF_UNIX)
+            return std::string("unix:") + reinterpret_cast<sockaddr_un &>(storage).sun_path;
+        char host[INET6_ADDRSTRLEN];
+        if (storage.ss_family == AF_INET)
+        {
+            auto &in = reinterpret_cast<sockaddr_in &>(storage);
+            ::inet_ntop(AF_INET, &in.sin_addr, host, sizeof(host));
+            return std::string(host) + ":" + std::to_string(ntohs(in.sin_port));
+        }
+        auto &in6 = reinterpret_cast<sockaddr_in6 &>(storage);
+        ::inet_ntop(AF_INET6, &in6.sin6_addr, host, sizeof(host));
+        return std::string(host) + ":" + std::to_string(ntohs(in6.sin6_port));
+    }
+
+    // A blocking connection to `address`, with Nagle off for TCP so that a
+    // request is not held back waiting for the previous reply's ACK.
+    inline Socket connect_to(const std::string &address)
+    {
+        sockaddr_storage storage;
+        socklen_t len = resolve(address, storage);
+        Socket socket(::socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (socket.get() < 0)
+            throw error("socket");
+        if (::connect(socket.get(), reinterpret_cast<sockaddr *>(&storage), len) != 0)
+            throw error("connect(" + address + ")");
+        int on = 1;
+        if (storage.ss_family != AF_UNIX)
+            ::setsockopt(socket.get(), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return socket;
+    }
+}
+
+// ================== Commands =====================
+// Runs one request against `store` and queues its reply. Command names are
+// case-insensitive:
+//
+//   PING                          +PONG
+//   GET key                       the value, or nil
+//   SET key value [PX ms]         +OK; PX sets a TTL in milliseconds
+//   DEL key [key ...]             the number of keys that were present
+//   MGET key [key ...]            an array of values or nils
+//   MSET key value [key value ...]  +OK
+//   INCR key, INCRBY key delta    the new value
+//   RANGE start end [COUNT n]     an array of key, value, key, value ... as
+//                                 KVStore::Scan returns them, for a store
+//                                 with KeyIndex::Ordered
+//
+// Errors that the store throws come back as -ERR replies.
+inline void execute_command(KVStore &store, const std::vector<std::string_view> &args, ReplyQueue &replies)
+{
+    auto is = [&args](std::string_view name)
+    {
+        return resp::is_keyword(args[0], name);
+    };
+    auto integer = [](std::string_view text, int64_t &value)
+    {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && end == text.data() + text.size();
+    };
+    auto arity = [&args, &replies](bool ok)
+    {
+        if (!ok)
+            replies.error("ERR wrong number of arguments for '" + std::string(args[0]) + "'");
+        return ok;
+    };
+
+    try
+    {
+        size_t n = args.size();
+        if (is("GET"))
+        {
+            if (arity(n == 2))
+                replies.bulk(store.Get(std::string(args[1])));
+        }
+        else if (is("SET"))
+        {
+            int64_t ms = 0;
+            if (!arity(n == 3 || n == 5))
+                return;
+            if (n == 5 && !(resp::is_keyword(args[3], "PX") && integer(args[4], ms) && ms > 0))
+                replies.error("ERR syntax error");
+            else
+            {
+                if (ms)
+                    store.Set(std::string(args[1]), std::string(args[2]), std::chrono::milliseconds(ms));
+                else
+                    store.Set(std::string(args[1]), std::string(args[2]));
+                replies.status("OK");
+            }
+        }
+        else if (is("DEL"))
+        {
+            if (!arity(n >= 2))
+                return;
+            std::vector<std::string> keys(args.begin() + 1, args.end());
+            replies.integer(store.MultiDelete(keys));
+        }
+        else if (is("MGET"))
+        {
+            if (!arity(n >= 2))
+                return;
+            std::vector<std::string> keys(args.begin() + 1, args.end());
+            auto values = store.MultiGet(keys);
+            replies.array(values.size());
+            for (auto &value : values)
+                replies.bulk(value);
+        }
+        else if (is("MSET"))
+        {
+            if (!arity(n >= 3 && n % 2 == 1))
+                return;
+            std::vector<std::pair<std::string, std::string>> items;
+            items.reserve(n / 2);
+            for (size_t i = 1; i < n; i += 2)
+                items.emplace_back(args[i], args[i + 1]);
+            store.MultiSet(items);
+            replies.status("OK");
+        }
+        else if (is("INCR") || is("INCRBY"))
+        {
+            int64_t delta = 1;
+            if (!arity(n == (is("INCR") ? 2 : 3)))
+                return;
+            if (n == 3 && !integer(args[2], delta))
+                replies.error("ERR value is not an integer");
+            else
+                replies.integer(store.Increment(std::string(args[1]), delta));
+        }
+        else if (is("RANGE"))
+        {
+            int64_t count = -1;
+            if (!arity(n == 3 || n == 5))
+                return;
+            if (n == 5 && !(resp::is_keyword(args[3], "COUNT") && integer(args[4], count) && count >= 0))
+            {
+                replies.error("ERR syntax error");
+                return;
+            }
+            auto found = count < 0 ? store.Scan(std::string(args[1]), std::string(args[2]))
+                                   : store.Scan(std::string(args[1]), std::string(args[2]), count);
+            replies.array(found.size() * 2);
+            for (auto &[key, value] : found)
+            {
+                replies.bulk(std::string_view(key));
+                replies.bulk(value);
+            }
+        }
+        else if (is("PING"))
+            replies.status("PONG");
+        else
+            replies.error("ERR unknown command '" + std::string(args[0]) + "'");
+    }
+    catch (const std::exception &e)
+    {
+        replies.error(std::string("ERR ") + e.what());
+    }
+}
+
+// ================== Server =====================
+// Serves a KVStore over the protocol in resp.h, with one event loop per
+// thread, by default one per core.
+//
+// Every loop has its own epoll instance and owns the connections it
+// accepts, so a connection is only ever touched by one thread and needs no
+// locking; the store does its own. All loops wait on the one listening
+// socket with EPOLLEXCLUSIVE, so a new connection wakes one of them, which
+// accepts it and keeps it.
+//
+// A readable connection is read once, up to kReadChunk bytes, and every
+// complete request in its buffer is run in order, the replies piling up in
+// its ReplyQueue; then the queue is flushed with one vectored send. The
+// requests run inside a KVStore::CommitScope, so on a durable store the
+// writes of a batch wait for the disk once, just before their replies go
+// out. A client pipelining requests therefore costs one read, one log
+// commit and one send per batch rather than per request. If the socket will not take all the replies,
+// the loop stops reading from that connection until they have drained,
+// which bounds the memory a client that never reads can make us hold.
+//
+// A connection the loop cannot take on, because the process is out of file
+// descriptors or epoll refuses it, is closed straight away rather than left
+// waiting on the listener, which would keep it readable and spin the loop.
+class KVServer
+{
+public:
+    static constexpr size_t kReadChunk = 64 << 10;
+    static constexpr int kMaxEvents = 256;
+
+    // Starts serving `store` on `address` (see kvnet). Port 0 picks a free
+    // one; address() reports it.
+    KVServer(KVStore &store, const std::string &address, unsigned loops = std::thread::hardware_concurrency())
+        : m_store(store), m_listener(kvnet::listen_on(address)), m_address(kvnet::local_address(m_listener))
+    {
+        for (unsigned i = 0; i < std::max(loops, 1u); i++)
+        {
+            auto loop = std::make_unique<Loop>();
+            loop->epoll = kvnet::Socket(::epoll_create1(EPOLL_CLOEXEC));
+            loop->wake = kvnet::Socket(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+            loop->spare = kvnet::Socket(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+            if (loop->epoll.get() < 0 || loop->wake.get() < 0 || loop->spare.get() < 0)
+                throw kvnet::error("epoll_create1/eventfd/open");
+            watch(*loop, m_listener.get(), EPOLLIN | EPOLLEXCLUSIVE, &kListenerTag);
+            watch(*loop, loop->wake.get(), EPOLLIN, &kWakeTag);
+            m_loops.push_back(std::move(loop));
+        }
+        for (auto &loop : m_loops)
+            loop->thread = std::thread([this, &loop = *loop]
+                                       { run(loop); });
+    }
+
+    // Stops the loops and closes every connection.
+    ~KVServer()
+    {
+        for (auto &loop : m_loops)
+        {
+            uint64_t one = 1;
+            [[maybe_unused]] auto n = ::write(loop->wake.get(), &one, sizeof(one));
+        }
+        for (auto &loop : m_loops)
+            loop->thread.join();
+        if (m_address.starts_with("unix:"))
+            ::unlink(m_address.c_str() + 5);
+    }
+
+    KVServer(const KVServer &) = delete;
+    KVServer &operator=(const KVServer &) = delete;
+
+    const std::string &address() const
+    {
+        return m_address;
+    }
+
+    // Requests run and vectored sends made, over all loops so far; their
+    // ratio is how many replies a send carries on average.
+    uint64_t requests() const
+    {
+        uint64_t n = 0;
+        for (auto &loop : m_loops)
+            n += loop->requests.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    uint64_t sends() const
+    {
+        uint64_t n = 0;
+        for (auto &loop : m_loops)
+            n += loop->sends.load(std::memory_order_relaxed);
+        return n;
+    }
+
+private:
+    struct Connection
+    {
+        kvnet::Socket socket;
+        std::vector<char> input;
+        size_t inputSize = 0;
+        ReplyQueue replies;
+        bool draining = false; // waiting for EPOLLOUT, not reading
+    };
+
+    struct alignas(64) Loop
+    {
+        kvnet::Socket epoll;
+        kvnet::Socket wake;
+        kvnet::Socket spare; // given up to accept and close a connection when out of descriptors
+        std::thread thread;
+        std::unordered_map<Connection *, std::unique_ptr<Connection>> connections;
+        std::vector<std::string_view> args; // reused for every request
+        // written by the loop only
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> sends{0};
+    };
+
+    // epoll_event tags for the two descriptors that are not connections
+    static inline char kListenerTag;
+    static inline char kWakeTag;
+
+    static void watch(Loop &loop, int fd, uint32_t events, void *tag, int op = EPOLL_CTL_ADD)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.ptr = tag;
+        if (::epoll_ctl(loop.epoll.get(), op, fd, &event) != 0)
+            throw kvnet::error("epoll_ctl");
+    }
+
+    void run(Loop &loop)
+    {
+        epoll_event events[kMaxEvents];
+        while (true)
+        {
+            int n = ::epoll_wait(loop.epoll.get(), events, kMaxEvents, -1);
+            if (n < 0 && errno != EINTR)
+                break;
+            for (int i = 0; i < n; i++)
+            {
+                void *tag = events[i].data.ptr;
+                if (tag == &kWakeTag)
+                {
+                    loop.connections.clear();
+                    return;
+                }
+                if (tag == &kListenerTag)
+                    accept_one(loop);
+                else
+                    serve(loop, *static_cast<Connection *>(tag), events[i].events);
+            }
+        }
+        loop.connections.clear();
+    }
+
+    // One connection per wakeup, so that a burst of them spreads over the
+    // loops instead of all going to the first one awake; the listener stays
+    // readable while more are waiting.
+    void accept_one(Loop &loop)
+    {
+        int fd = ::accept4(m_listener.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                // free a descriptor to take the connection off the queue with
+                loop.spare.reset();
+                ::close(::accept4(m_listener.get(), nullptr, nullptr, SOCK_CLOEXEC));
+                loop.spare = kvnet::Socket(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+            }
+            return; // EAGAIN: another loop took it
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->socket = kvnet::Socket(fd);
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on Unix sockets
+        try
+        {
+            watch(loop, fd, EPOLLIN | EPOLLRDHUP, connection.get());
+        }
+        catch (const std::runtime_error &)
+        {
+            return; // closes it
+        }
+        loop.connections.emplace(connection.get(), std::move(connection));
+    }
+
+    void serve(Loop &loop, Connection &connection, uint32_t events)
+    {
+        bool open = true;
+        if (connection.draining)
+            open = !(events & EPOLLERR) && send(loop, connection);
+        else
+            open = receive(loop, connection);
+        if (!open)
+            close(loop, connection);
+    }
+
+    // Reads what has arrived, runs every complete request and sends the
+    // replies. Returns false once the connection is done with.
+    bool receive(Loop &loop, Connection &connection)
+    {
+        auto &input = connection.input;
+        if (input.size() - connection.inputSize < kReadChunk)
+            input.resize(connection.inputSize + kReadChunk);
+        ssize_t n = ::recv(connection.socket.get(), input.data() + connection.inputSize, kReadChunk, 0);
+        if (n == 0)
+            return false;
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        connection.inputSize += n;
+
+        size_t pos = 0, used = 0;
+        bool broken = false;
+        KVStore::CommitScope batch(m_store);
+        while (true)
+        {
+            auto parsed = resp::parse_command(input.data() + pos, connection.inputSize - pos, loop.args, used);
+            if (parsed == resp::Parse::Incomplete)
+                break;
+            if (parsed == resp::Parse::Error)
+            {
+                connection.replies.error("ERR protocol error");
+                broken = true;
+                break;
+            }
+            execute_command(m_store, loop.args, connection.replies);
+            loop.requests.fetch_add(1, std::memory_order_relaxed);
+            pos += used;
+        }
+        try
+        {
+            batch.commit();
+        }
+        catch (const std::runtime_error &)
+        {
+            return false; // the log failed: acknowledge none of the batch
+        }
+        // keep the start of an incomplete request for the next read
+        std::memmove(input.data(), input.data() + pos, connection.inputSize - pos);
+        connection.inputSize -= pos;
+        if (input.size() > 4 * kReadChunk && connection.inputSize < kReadChunk)
+        {
+            input.resize(kReadChunk);
+            input.shrink_to_fit();
+        }
+        return send(loop, connection) && !broken;
+    }
+
+    // Flushes the replies, and switches the connection between reading and
+    // waiting to write as the socket fills up and drains.
+    bool send(Loop &loop, Connection &connection)
+    {
+        if (connection.replies.empty())
+            return true;
+        loop.sends.fetch_add(1, std::memory_order_relaxed);
+        if (!connection.replies.flush(connection.socket.get()))
+            return false;
+        bool full = !connection.replies.empty();
+        if (full != connection.draining)
+        {
+            connection.draining = full;
+            try
+            {
+                watch(loop, connection.socket.get(), full ? EPOLLOUT : EPOLLIN | EPOLLRDHUP, &connection,
+                      EPOLL_CTL_MOD);
+            }
+            catch (const std::runtime_error &)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close(Loop &loop, Connection &connection)
+    {
+        ::epoll_ctl(loop.epoll.get(), EPOLL_CTL_DEL, connection.socket.get(), nullptr);
+        loop.connections.erase(&connection);
+    }
+
+    KVStore &m_store;
+    kvnet::Socket m_listener;
+    std::string m_address;
+    std::vector<std::unique_ptr<Loop>> m_loops;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// ================== Epoch-based reclamation =====================
+// Lets readers walk a structure that writers are changing, with no locks,
+// and defers freeing what a writer unlinks until no reader can still be
+// looking at it.
+//
+// A reader pins the current global epoch for the length of its read by
+// writing it into its own thread record, the only store it makes, and to a
+// cache line no other thread writes. A writer unlinks an object and retires
+// it, stamped with the epoch at the time. The global epoch only advances
+// once every pinned thread has caught up with it, so once it has moved two
+// past an object's stamp, every reader that could have seen the object has
+// unpinned and the object is freed.
+//
+// One domain is shared by the whole process, like the node pools. Retired
+// objects sit in a private list per thread and are freed by that thread in
+// batches of kCollectBatch; a thread that exits hands what is left to the
+// domain, where the next collection picks it up.
+class EpochDomain
+{
+public:
+    static constexpr size_t kCollectBatch = 64;
+
+    static EpochDomain &getInstance()
+    {
+        static EpochDomain instance;
+        return instance;
+    }
+
+    // Keeps everything reachable when it was created alive until destroyed.
+    // Cheap enough to create per read, and nests.
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain &domain) : m_domain(domain)
+        {
+            m_domain.enter();
+        }
+
+        ~Guard()
+        {
+            m_domain.leave();
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+    private:
+        EpochDomain &m_domain;
+    };
+
+    Guard pin()
+    {
+        return Guard(*this);
+    }
+
+    // `object` must already be unreachable for readers that pin from now on.
+    void retire(void *object, void (*deleter)(void *))
+    {
+        auto &record = local_record();
+        record.retired.push_back({object, deleter, m_epoch.load(std::memory_order_seq_cst)});
+        if (record.retired.size() >= record.collectAt)
+        {
+            collect(record);
+            // don't rescan on every retire while a slow reader holds us back
+            record.collectAt = record.retired.size() + kCollectBatch;
+        }
+    }
+
+    template <typename T>
+    void retire(T *object)
+    {
+        retire(object, [](void *p)
+               { delete static_cast<T *>(p); });
+    }
+
+    ~EpochDomain()
+    {
+        for (Record *record = m_records.load(); record;)
+        {
+            Record *next = record->next;
+            free_all(record->retired);
+            delete record;
+            record = next;
+        }
+        free_all(m_orphans);
+    }
+
+private:
+    struct Retired
+    {
+        void *object;
+        void (*deleter)(void *);
+        uint64_t epoch;
+    };
+
+    struct alignas(64) Record
+    {
+        std::atomic<uint64_t> epoch{0}; // pinned epoch, 0 when not reading
+        std::atomic<bool> inUse{true};
+        unsigned depth = 0;
+        std::vector<Retired> retired;
+        size_t collectAt = kCollectBatch;
+        Record *next = nullptr;
+    };
+
+    // Claims a record when the thread first uses the domain, and gives it
+    // back for another thread to reuse when the thread exits.
+    struct LocalRecord
+    {
+        Record *record;
+
+        LocalRecord() : record(EpochDomain::getInstance().acquire_record()) {}
+
+        ~LocalRecord()
+        {
+            EpochDomain::getInstance().release_record(record);
+        }
+    };
+
+    EpochDomain() = default;
+
+    void enter()
+    {
+        auto &record = local_record();
+        if (record.depth++ > 0)
+            return;
+        record.epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // the pin must be visible before we load any pointer it protects
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void leave()
+    {
+        auto &record = local_record();
+        if (--record.depth == 0)
+            record.epoch.store(0, std::memory_order_release);
+    }
+
+    // Advances the global epoch if every pinned thread is in the current one.
+    bool try_advance()
+    {
+        uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record *record = m_records.load(std::memory_order_acquire); record; record = record->next)
+        {
+            uint64_t pinned = record->epoch.load(std::memory_order_acquire);
+            if (pinned != 0 && pinned != epoch)
+                return false;
+        }
+        return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+    }
+
+    void collect(Record &record)
+    {
+        try_advance();
+        uint64_t safe = m_epoch.load(std::memory_order_seq_cst);
+        free_before(record.retired, safe);
+
+        if (m_hasOrphans.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> guard(m_orphanMutex);
+            free_before(m_orphans, safe);
+            m_hasOrphans.store(!m_orphans.empty(), std::memory_order_relaxed);
+        }
+    }
+
+    // Frees what was retired at least two epochs before `epoch`, up to the
+    // first entry that is too recent; lists are roughly in retire order.
+    static void free_before(std::vector<Retired> &retired, uint64_t epoch)
+    {
+        size_t n = 0;
+        while (n < retired.size() && retired[n].epoch + 2 <= epoch)
+        {
+            retired[n].deleter(retired[n].object);
+            n++;
+        }
+        retired.erase(retired.begin(), retired.begin() + n);
+    }
+
+    static void free_all(std::vector<Retired> &retired)
+    {
+        for (auto &r : retired)
+            r.deleter(r.object);
+        retired.clear();
+    }
+
+    Record *acquire_record()
+    {
+        for (Record *record = m_records.load(std::memory_order_acquire); record; record = record->next)
+        {
+            bool free = false;
+            if (record->inUse.compare_exchange_strong(free, true, std::memory_order_acquire))
+                return record;
+        }
+        // records are never unlinked, so pushing with a CAS is safe
+        auto *record = new Record;
+        record->next = m_records.load(std::memory_order_relaxed);
+        while (!m_records.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                                std::memory_order_relaxed))
+        {
+        }
+        return record;
+    }
+
+    void release_record(Record *record)
+    {
+        if (!record->retired.empty())
+        {
+            std::lock_guard<std::mutex> guard(m_orphanMutex);
+            m_orphans.insert(m_orphans.end(), record->retired.begin(), record->retired.end());
+            m_hasOrphans.store(true, std::memory_order_relaxed);
+            record->retired.clear();
+        }
+        record->collectAt = kCollectBatch;
+        record->inUse.store(false, std::memory_order_release);
+    }
+
+    static Record &local_record()
+    {
+        static thread_local LocalRecord local;
+        return *local.record;
+    }
+
+    alignas(64) std::atomic<uint64_t> m_epoch{1};
+    std::atomic<Record *> m_records{nullptr};
+
+    std::mutex m_orphanMutex;
+    std::vector<Retired> m_orphans;
+    std::atomic<bool> m_hasOrphans{false};
+};
@@ -0,0 +1,1124 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <charconv>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+#include "epoch.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "skiplist.h"
+#include "../../raii/shared-ptr/shared_ptr.h"
+
+struct DurabilityOptions
+{
+    SyncMode sync = SyncMode::Group;
+    // a background checkpoint starts once the log grows past this, 0 leaves
+    // checkpoints to explicit Checkpoint() calls
+    size_t checkpointBytes = 64 << 20;
+    // threads loading the snapshot at startup
+    unsigned loadThreads = std::thread::hardware_concurrency();
+};
+
+enum class KeyIndex
+{
+    Hash,    // point lookups only
+    Ordered, // also keeps the keys sorted, for Scan and ScanPrefix
+};
+
+// A thread-safe string key/value store, built for read-mostly traffic.
+//
+// The keyspace is split into a power-of-two number of shards. Writers lock
+// their key's shard; readers take no lock at all and write no shared memory.
+//
+// Each shard is an open-addressing table of pointers to immutable entries.
+// A writer never changes an entry in place: Set publishes a new entry in the
+// slot, Delete replaces it with a tombstone, and a table that fills up is
+// rebuilt and swapped in whole. A reader therefore always sees either the
+// old or the new version of a key, never a torn one, and never has to retry.
+// Replaced entries and tables are handed to the EpochDomain, which frees
+// them once every reader that might still hold them has finished.
+//
+// Values are immutable, reference-counted buffers. Get hands back a Value
+// sharing the stored buffer, so its cost does not depend on the value's
+// size; Read() lends the bytes to a callback without even the reference
+// count update, for readers that want to write no shared memory at all.
+//
+// Opened on a directory, the store is durable. Set and Delete append a
+// record to a write-ahead log inside their shard lock, so the log order
+// matches the order the changes were applied in, then wait for it to be on
+// disk outside the lock, sharing fsyncs with concurrent writers (see
+// WriteAheadLog). A checkpoint starts a new log segment, writes a snapshot
+// of the tables and deletes the older segments and snapshots. The snapshot
+// is taken while writers carry on, so it may include changes that are also
+// in the new segment; replaying them again on startup is harmless, since a
+// Set or Delete record leaves the key in the same state however often it
+// is applied.
+//
+// Files in the directory, N counting checkpoints: snapshot-N.kvs holds
+// everything logged before wal-N.log was started.
+//
+// As a cache, keys may be Set with a TTL and the store may be given a
+// memory budget. An expired key reads as absent straight away; a background
+// sweeper, started by the first Set with a TTL, removes them a few slots at
+// a time, walking each shard with a cursor so that every step costs the
+// same however large the table is. Over budget, the writer that crossed it
+// evicts with CLOCK: a hand walks the slots, sparing and clearing entries
+// Get has marked as referenced since the hand last passed, and evicting the
+// first unmarked one. Get marks with a relaxed store only when the mark is
+// clear, so a hot key costs its readers one shared write per hand sweep.
+//
+// With KeyIndex::Ordered every entry is also published in a SkipList, for
+// range and prefix scans. Get still goes through the hash tables; writers
+// update the list under their shard lock, right after the table, and only
+// serialize with each other when a key is added or removed.
+class KVStore
+{
+public:
+    // A read-only handle on a stored value. Copying it, or the key being
+    // overwritten, deleted or evicted meanwhile, never copies the bytes;
+    // they are freed with the last handle. Empty for an absent key.
+    class Value
+    {
+    public:
+        Value() = default;
+
+        std::string_view view() const
+        {
+            return m_buffer ? std::string_view(*m_buffer) : std::string_view();
+        }
+
+        operator std::string_view() const
+        {
+            return view();
+        }
+
+        // a copy of the bytes
+        std::string str() const
+        {
+            return std::string(view());
+        }
+
+        const char *data() const
+        {
+            return view().data();
+        }
+
+        size_t size() const
+        {
+            return view().size();
+        }
+
+        bool empty() const
+        {
+            return view().empty();
+        }
+
+        friend bool operator==(const Value &value, std::string_view other)
+        {
+            return value.view() == other;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const Value &value)
+        {
+            return out << value.view();
+        }
+
+    private:
+        friend class KVStore;
+
+        explicit Value(const SharedPointer<const std::string> &buffer) : m_buffer(buffer) {}
+
+        SharedPointer<const std::string> m_buffer;
+    };
+
+    // Batches one thread's waits for the disk. While a scope is open, the
+    // thread's writes to the store return once they are applied and logged,
+    // and commit() then waits for all of them at once. A caller that
+    // acknowledges a batch of writes together, like the server answering a
+    // pipeline of requests, pays one group commit for the batch instead of
+    // one per write. None of the writes is durable until commit() returns.
+    // Closing a scope without commit() leaves its writes to be made durable
+    // by later ones.
+    class CommitScope
+    {
+    public:
+        explicit CommitScope(KVStore &store) : m_store(store), m_outer(t_commitScope)
+        {
+            t_commitScope = this;
+        }
+
+        ~CommitScope()
+        {
+            t_commitScope = m_outer;
+        }
+
+        CommitScope(const CommitScope &) = delete;
+        CommitScope &operator=(const CommitScope &) = delete;
+
+        // Throws std::runtime_error if writing the log failed.
+        void commit()
+        {
+            m_store.wait_durable(std::exchange(m_lsn, 0));
+        }
+
+    private:
+        friend class KVStore;
+
+        KVStore &m_store;
+        CommitScope *const m_outer;
+        uint64_t m_lsn = 0; // the last record logged inside the scope
+    };
+
+    // `shards` is rounded up to a power of two
+    explicit KVStore(size_t shards = 64, KeyIndex index = KeyIndex::Hash)
+        : m_shardBits(std::bit_width(std::bit_ceil(shards ? shards : 1)) - 1),
+          m_shards(std::make_unique<Shard[]>(size_t{1} << m_shardBits)),
+          m_epochs(EpochDomain::getInstance()),
+          m_index(index == KeyIndex::Ordered ? std::make_unique<SkipList<Entry>>() : nullptr)
+    {
+        for (size_t i = 0; i < num_shards(); i++)
+            m_shards[i].table.store(new Table(kMinSlots), std::memory_order_relaxed);
+    }
+
+    // Recovers the store in `dir`, creating the directory if needed: loads
+    // the newest snapshot, replays the log segments written since, and
+    // starts a new segment.
+    explicit KVStore(const std::string &dir, DurabilityOptions options = {}, size_t shards = 64,
+                     KeyIndex index = KeyIndex::Hash)
+        : KVStore(shards, index)
+    {
+        std::filesystem::create_directories(dir);
+        auto durability = std::make_unique<Durability>();
+        durability->dir = dir;
+        durability->options = options;
+
+        uint64_t base = 0, last = 0;
+        for (auto &file : std::filesystem::directory_iterator(dir))
+        {
+            uint64_t id;
+            auto name = file.path().filename().string();
+            if (parse_file_name(name, "snapshot-", ".kvs", id))
+                base = std::max(base, id);
+            else if (parse_file_name(name, "wal-", ".log", id))
+                last = std::max(last, id);
+        }
+        uint64_t now = now_ms();
+        // set from every snapshot loader thread
+        std::atomic<bool> expiring{false};
+        if (base)
+            load_snapshot(
+                snapshot_path(dir, base), [this, now, &expiring](std::string_view key, std::string_view value, uint64_t expiresAt)
+                {
+                    if (expiresAt && expiresAt <= now)
+                        return;
+                    put(key, value, expiresAt);
+                    if (expiresAt)
+                        expiring.store(true, std::memory_order_relaxed); },
+                options.loadThreads);
+        for (uint64_t id = std::max<uint64_t>(base, 1); id <= last; id++)
+            WriteAheadLog::replay(wal_path(dir, id), [this, now, &expiring](WalOp op, std::string_view key, std::string_view value, uint64_t expiresAt)
+                                  {
+                                      // a Set that has expired since still replaces what came before
+                                      if (op == WalOp::Set && !(expiresAt && expiresAt <= now))
+                                          put(key, value, expiresAt);
+                                      else
+                                          erase(key);
+                                      if (expiresAt)
+                                          expiring.store(true, std::memory_order_relaxed); });
+        if (expiring.load(std::memory_order_relaxed))
+            start_sweeper();
+
+        durability->segment = std::max(base, last) + 1;
+        durability->wal = std::make_unique<WriteAheadLog>(wal_path(dir, durability->segment), options.sync);
+        kvdisk::sync_directory(dir);
+        remove_files_before(dir, base);
+        m_durability = std::move(durability);
+
+        if (options.checkpointBytes)
+            m_durability->checkpointer = std::thread([this]
+                                                     { checkpoint_loop(); });
+    }
+
+    ~KVStore()
+    {
+        if (m_sweeper.thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_sweeper.mutex);
+                m_sweeper.stopping = true;
+            }
+            m_sweeper.wake.notify_one();
+            m_sweeper.thread.join();
+        }
+        if (m_durability && m_durability->checkpointer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_durability->mutex);
+                m_durability->stopping = true;
+            }
+            m_durability->wake.notify_one();
+            m_durability->checkpointer.join();
+        }
+        for (size_t i = 0; i < num_shards(); i++)
+        {
+            Table *table = m_shards[i].table.load(std::memory_order_relaxed);
+            for (size_t s = 0; s <= table->mask; s++)
+            {
+                Entry *entry = table->slots[s].load(std::memory_order_relaxed);
+                if (entry && entry != tombstone())
+                    delete entry;
+            }
+            delete table;
+        }
+    }
+
+    KVStore(const KVStore &) = delete;
+    KVStore &operator=(const KVStore &) = delete;
+
+    // On a durable store, returns once the change is on disk. Throws
+    // std::runtime_error if the log cannot be written.
+    void Set(const std::string &key, const std::string &value)
+    {
+        commit(put(key, value));
+    }
+
+    // The key reads as absent once `ttl` has passed.
+    void Set(const std::string &key, const std::string &value, std::chrono::milliseconds ttl)
+    {
+        start_sweeper();
+        commit(put(key, value, now_ms() + std::max<int64_t>(ttl.count(), 1)));
+    }
+
+    // Returns an empty Value if the key is absent or expired.
+    Value Get(const std::string &key) const
+    {
+        uint64_t hash = hash_of(key);
+        auto &shard = shard_for(hash);
+        auto guard = m_epochs.pin();
+        if (const Entry *entry = find_live(shard, hash, key))
+            return Value(entry->value);
+        return Value();
+    }
+
+    // Calls read(std::string_view) with the value and returns true, or
+    // returns false if the key is absent or expired. The view is only valid
+    // during the call, which should be short: it holds back reclamation.
+    template <typename Reader>
+    bool Read(const std::string &key, Reader &&read) const
+    {
+        uint64_t hash = hash_of(key);
+        auto &shard = shard_for(hash);
+        auto guard = m_epochs.pin();
+        const Entry *entry = find_live(shard, hash, key);
+        if (!entry)
+            return false;
+        read(entry->bytes());
+        return true;
+    }
+
+    // Returns whether the key was present, expired keys counting as absent.
+    bool Delete(const std::string &key)
+    {
+        bool removed;
+        commit(erase(key, removed));
+        return removed;
+    }
+
+    // Delete for every key, waiting for the disk once for the lot on a
+    // durable store. Returns how many of the keys were present; a key given
+    // twice counts once.
+    size_t MultiDelete(const std::vector<std::string> &keys)
+    {
+        size_t count = 0;
+        uint64_t lsn = 0;
+        for (auto &key : keys)
+        {
+            bool removed;
+            lsn = std::max(lsn, erase(key, removed));
+            count += removed;
+        }
+        commit(lsn);
+        return count;
+    }
+
+    // Get for every key, in order, under one epoch pin. The slots are
+    // prefetched in a first pass, so the cache misses of a large batch
+    // overlap instead of being paid one after the other.
+    std::vector<Value> MultiGet(const std::vector<std::string> &keys) const
+    {
+        std::vector<uint64_t> hashes(keys.size());
+        std::vector<Value> values(keys.size());
+        auto guard = m_epochs.pin();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            hashes[i] = hash_of(keys[i]);
+            const Table *table = shard_for(hashes[i]).table.load(std::memory_order_acquire);
+            __builtin_prefetch(&table->slots[hashes[i] & table->mask]);
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (const Entry *entry = find_live(shard_for(hashes[i]), hashes[i], keys[i]))
+                values[i] = Value(entry->value);
+        }
+        return values;
+    }
+
+    // Set for every pair, locking each shard involved once and, on a
+    // durable store, waiting for the disk once for the lot. If a key is
+    // given twice the later value wins. Not atomic as a whole: readers can
+    // see some of the pairs before the rest, and if it throws partway, the
+    // pairs applied so far stay applied but are not waited for.
+    void MultiSet(const std::vector<std::pair<std::string, std::string>> &items)
+    {
+        // counting sort by shard, which keeps the order within a shard
+        std::vector<uint32_t> start(num_shards() + 1);
+        std::vector<uint64_t> hashes(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            hashes[i] = hash_of(items[i].first);
+            start[shard_index(hashes[i]) + 1]++;
+        }
+        for (size_t i = 1; i <= num_shards(); i++)
+            start[i] += start[i - 1];
+
+        // Entries from `published` on are still ours, and freed if making
+        // or publishing one throws; put_locked hands its entry to the table
+        // even when logging it fails.
+        struct Unpublished
+        {
+            KVStore &store;
+            std::vector<Entry *> entries;
+            size_t published = 0;
+
+            ~Unpublished()
+            {
+                for (size_t i = published; i < entries.size(); i++)
+                {
+                    if (Entry *entry = entries[i])
+                    {
+                        store.m_memoryUsage.fetch_sub(entry->footprint(), std::memory_order_relaxed);
+                        delete entry;
+                    }
+                }
+            }
+        } byShard{*this, std::vector<Entry *>(items.size())};
+        std::vector<uint32_t> next(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < items.size(); i++)
+            byShard.entries[next[shard_index(hashes[i])]++] = make_entry(items[i].first, items[i].second, 0);
+
+        uint64_t lsn = 0;
+        for (size_t index = 0; index < num_shards(); index++)
+        {
+            if (start[index] == start[index + 1])
+                continue;
+            auto &shard = m_shards[index];
+            std::lock_guard<std::mutex> lock(shard.writeMutex);
+            for (size_t i = start[index]; i < start[index + 1]; i++)
+            {
+                byShard.published = i + 1;
+                lsn = std::max(lsn, put_locked(shard, byShard.entries[i]));
+            }
+        }
+        commit(lsn);
+    }
+
+    // Sets `key` to `desired` if its value is `expected`, "" standing for an
+    // absent or expired key as it does for Get. Returns whether it did. The
+    // new value has no TTL.
+    bool CompareAndSet(const std::string &key, const std::string &expected, const std::string &desired)
+    {
+        uint64_t hash = hash_of(key);
+        auto &shard = shard_for(hash);
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(shard.writeMutex);
+            auto *slot = locate(shard, hash, key);
+            Entry *current = slot ? slot->load(std::memory_order_relaxed) : nullptr;
+            std::string_view value = current && !current->expired(now_ms()) ? current->bytes() : std::string_view();
+            if (value != expected)
+                return false;
+            lsn = put_locked(shard, make_entry(key, desired, 0));
+        }
+        commit(lsn);
+        return true;
+    }
+
+    // Adds `delta` to the integer stored at `key`, an absent or expired key
+    // or an empty value counting as 0, as "" stands for absent in Get and
+    // CompareAndSet, and returns the result. A TTL on the key is kept.
+    // Throws std::runtime_error, leaving the value as it was, if it is not
+    // an integer or the sum would overflow. Logged as a Set of the result,
+    // so replaying it twice does not add twice.
+    int64_t Increment(const std::string &key, int64_t delta = 1)
+    {
+        uint64_t hash = hash_of(key);
+        auto &shard = shard_for(hash);
+        int64_t result = 0;
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(shard.writeMutex);
+            auto *slot = locate(shard, hash, key);
+            Entry *current = slot ? slot->load(std::memory_order_relaxed) : nullptr;
+            uint64_t expiresAt = 0;
+            if (current && !current->expired(now_ms()))
+            {
+                auto value = current->bytes();
+                auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+                if (!value.empty() && (ec != std::errc() || end != value.data() + value.size()))
+                    throw std::runtime_error("KVStore: value of " + key + " is not an integer");
+                expiresAt = current->expiresAt;
+            }
+            if (__builtin_add_overflow(result, delta, &result))
+                throw std::runtime_error("KVStore: increment of " + key + " would overflow");
+            lsn = put_locked(shard, make_entry(key, std::to_string(result), expiresAt));
+        }
+        commit(lsn);
+        return result;
+    }
+
+    // Up to `limit` live keys in [start, end), in byte order, with their
+    // values; an empty `end` means no upper bound. Throws std::logic_error
+    // unless the store was made with KeyIndex::Ordered.
+    //
+    // Not a point-in-time view, since writers carry on: every key comes
+    // back at most once, with a value it held at some point during the
+    // scan, and a key present throughout the scan always comes back. Keys
+    // are read kScanBatch at a time, one epoch pin each, so a long scan
+    // does not hold back reclamation. Unlike Get, a scan does not mark
+    // entries for the eviction hand, so one large scan cannot push the
+    // working set out of a budgeted store.
+    std::vector<std::pair<std::string, Value>> Scan(const std::string &start, const std::string &end,
+                                                    size_t limit = std::numeric_limits<size_t>::max()) const
+    {
+        if (!m_index)
+            throw std::logic_error("KVStore: Scan needs KeyIndex::Ordered");
+        std::vector<std::pair<std::string, Value>> out;
+        std::string from = start;
+        uint64_t now = now_ms();
+        while (out.size() < limit)
+        {
+            auto guard = m_epochs.pin();
+            size_t batchEnd = std::min(limit, out.size() + kScanBatch);
+            auto it = m_index->seek(from);
+            for (; it.valid() && out.size() < batchEnd; it.next())
+            {
+                if (!end.empty() && it.key() >= end)
+                    return out;
+                const Entry *entry = it.value();
+                if (!entry->expired(now))
+                    out.emplace_back(entry->key, Value(entry->value));
+            }
+            if (!it.valid())
+                return out;
+            // the smallest key after the last one returned
+            from = out.back().first;
+            from.push_back('\0');
+        }
+        return out;
+    }
+
+    // Scan of the keys starting with `prefix`.
+    std::vector<std::pair<std::string, Value>> ScanPrefix(const std::string &prefix,
+                                                          size_t limit = std::numeric_limits<size_t>::max()) const
+    {
+        // the first key past every key with the prefix: drop trailing 0xff
+        // bytes and bump the last one left; none left means no bound
+        std::string end = prefix;
+        while (!end.empty() && static_cast<unsigned char>(end.back()) == 0xff)
+            end.pop_back();
+        if (!end.empty())
+            end.back() = static_cast<char>(static_cast<unsigned char>(end.back()) + 1);
+        return Scan(prefix, end, limit);
+    }
+
+    // Writes a snapshot and drops the log segments it covers. Runs by
+    // itself once the log passes DurabilityOptions::checkpointBytes; Set,
+    // Delete and Get carry on meanwhile.
+    void Checkpoint()
+    {
+        if (!m_durability)
+            throw std::logic_error("KVStore: Checkpoint on an in-memory store");
+        auto &d = *m_durability;
+        std::lock_guard<std::mutex> guard(d.checkpointMutex);
+        uint64_t id = d.segment + 1;
+        d.wal->rotate(wal_path(d.dir, id));
+        kvdisk::sync_directory(d.dir);
+        d.segment = id;
+
+        SnapshotWriter writer(snapshot_path(d.dir, id), num_shards());
+        uint64_t now = now_ms();
+        for (size_t i = 0; i < num_shards(); i++)
+        {
+            // one shard per pin, so reclamation is only held up that long
+            auto pin = m_epochs.pin();
+            const Table *table = m_shards[i].table.load(std::memory_order_acquire);
+            for (size_t s = 0; s <= table->mask; s++)
+            {
+                const Entry *entry = table->slots[s].load(std::memory_order_acquire);
+                if (entry && entry != tombstone() && !entry->expired(now))
+                    writer.add(entry->key, entry->bytes(), entry->expiresAt);
+            }
+            writer.end_section();
+        }
+        writer.finish(d.dir);
+        remove_files_before(d.dir, id);
+    }
+
+    // fsyncs issued by the write-ahead log, 0 for an in-memory store.
+    uint64_t log_syncs() const
+    {
+        return m_durability ? m_durability->wal->syncs() : 0;
+    }
+
+    // Evicts until the approximate memory in use, counting keys, values and
+    // per-entry overhead but not the tables or the ordered index, is within
+    // `bytes`. 0 disables.
+    void set_memory_budget(size_t bytes)
+    {
+        m_memoryBudget.store(bytes, std::memory_order_relaxed);
+        enforce_budget();
+    }
+
+    size_t memory_usage() const
+    {
+        return m_memoryUsage.load(std::memory_order_relaxed);
+    }
+
+    uint64_t evictions() const
+    {
+        return m_evictions.load(std::memory_order_relaxed);
+    }
+
+    // Keys removed by the sweeper; expired keys that are overwritten,
+    // deleted or evicted first are not counted.
+    uint64_t expirations() const
+    {
+        return m_expirations.load(std::memory_order_relaxed);
+    }
+
+    // Not a point-in-time count: shards are locked one after the other.
+    // Includes expired keys the sweeper has not reached yet.
+    size_t Size() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < num_shards(); i++)
+        {
+            std::lock_guard<std::mutex> lock(m_shards[i].writeMutex);
+            n += m_shards[i].live;
+        }
+        return n;
+    }
+
+    size_t num_shards() const
+    {
+        return size_t{1} << m_shardBits;
+    }
+
+private:
+    static constexpr size_t kMinSlots = 16;
+    // slots a sweep step examines, and steps per sweep round
+    static constexpr size_t kSweepSlots = 32;
+    static constexpr size_t kSweepSteps = 64;
+    static constexpr std::chrono::milliseconds kSweepInterval{100};
+    // keys a Scan reads per epoch pin
+    static constexpr size_t kScanBatch = 256;
+
+    struct Sweeper
+    {
+        std::once_flag started;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        size_t nextShard = 0; // sweeper thread only
+    };
+
+    struct Durability
+    {
+        std::string dir;
+        DurabilityOptions options;
+        std::unique_ptr<WriteAheadLog> wal;
+        uint64_t segment = 0; // N of the wal-N.log being appended to
+        std::mutex checkpointMutex;
+
+        // background checkpoints
+        std::thread checkpointer;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<bool> requested{false};
+        bool stopping = false;
+    };
+
+    struct Entry
+    {
+        const uint64_t hash;
+        const uint64_t expiresAt; // ms since the Unix epoch, 0 for never
+        const std::string key;
+        const SharedPointer<const std::string> value;
+        // set by Get, cleared by the eviction hand as it passes
+        mutable std::atomic<bool> referenced{false};
+
+        bool expired(uint64_t now) const
+        {
+            return expiresAt && expiresAt <= now;
+        }
+
+        std::string_view bytes() const
+        {
+            return *value;
+        }
+
+        // what the store holds; a buffer still referenced by a Value after
+        // its entry is gone is not counted
+        size_t footprint() const
+        {
+            return sizeof(Entry) + sizeof(std::string) + key.size() + value->size();
+        }
+    };
+
+    struct Table
+    {
+        explicit Table(size_t slots)
+            : mask(slots - 1), slots(std::make_unique<std::atomic<Entry *>[]>(slots)) {}
+
+        const size_t mask;
+        // nullptr ends a probe, tombstone() continues it
+        std::unique_ptr<std::atomic<Entry *>[]> slots;
+    };
+
+    struct alignas(64) Shard
+    {
+        // the only field readers touch, away from the lines writers dirty
+        std::atomic<Table *> table{nullptr};
+
+        alignas(64) mutable std::mutex writeMutex;
+        size_t live = 0; // entries
+        size_t used = 0; // entries and tombstones, a probe stops only past both
+        size_t sweepCursor = 0;
+        size_t clockHand = 0;
+    };
+
+    static Entry *tombstone()
+    {
+        static Entry deleted{0, 0, {}, {}};
+        return &deleted;
+    }
+
+    static uint64_t hash_of(std::string_view key)
+    {
+        // Fibonacci mix, so both the slot (low bits) and the shard (high
+        // bits) are spread well whatever std::hash does
+        return std::hash<std::string_view>{}(key) * 0x9E3779B97F4A7C15ull;
+    }
+
+    size_t shard_index(uint64_t hash) const
+    {
+        return m_shardBits ? hash >> (64 - m_shardBits) : 0;
+    }
+
+    Shard &shard_for(uint64_t hash) const
+    {
+        return m_shards[shard_index(hash)];
+    }
+
+    static uint64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Must be called inside an epoch guard. The result stays valid until
+    // the guard is released.
+    static const Entry *find(const Shard &shard, uint64_t hash, std::string_view key)
+    {
+        const Table *table = shard.table.load(std::memory_order_acquire);
+        for (size_t s = hash & table->mask;; s = (s + 1) & table->mask)
+        {
+            const Entry *entry = table->slots[s].load(std::memory_order_acquire);
+            if (!entry)
+                return nullptr;
+            if (entry != tombstone() && entry->hash == hash && entry->key == key)
+                return entry;
+        }
+    }
+
+    // find() for readers: skips an expired entry, and marks the one it
+    // returns as referenced for the eviction hand.
+    const Entry *find_live(const Shard &shard, uint64_t hash, std::string_view key) const
+    {
+        const Entry *entry = find(shard, hash, key);
+        if (!entry || (entry->expiresAt && entry->expired(now_ms())))
+            return nullptr;
+        if (!entry->referenced.load(std::memory_order_relaxed) && m_memoryBudget.load(std::memory_order_relaxed))
+            entry->referenced.store(true, std::memory_order_relaxed);
+        return entry;
+    }
+
+    // Applies a Set under the shard lock and, on a durable store, logs it
+    // there too. Returns the record's LSN, or 0 if nothing was logged.
+    uint64_t put(std::string_view key, std::string_view value, uint64_t expiresAt = 0)
+    {
+        Entry *entry = make_entry(key, value, expiresAt);
+        auto &shard = shard_for(entry->hash);
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        return put_locked(shard, entry);
+    }
+
+    Entry *make_entry(std::string_view key, std::string_view value, uint64_t expiresAt)
+    {
+        auto *entry = new Entry{hash_of(key), expiresAt, std::string(key),
+                                SharedPointer<const std::string>(new std::string(value))};
+        m_memoryUsage.fetch_add(entry->footprint(), std::memory_order_relaxed);
+        return entry;
+    }
+
+    // Called with the shard lock held. Publishes `entry` in place of the
+    // current one for its key, if any, and logs it.
+    uint64_t put_locked(Shard &shard, Entry *entry)
+    {
+        Table *table = shard.table.load(std::memory_order_relaxed);
+        std::atomic<Entry *> *reuse = nullptr;
+        size_t s = entry->hash & table->mask;
+        for (;; s = (s + 1) & table->mask)
+        {
+            Entry *current = table->slots[s].load(std::memory_order_relaxed);
+            if (!current)
+                break;
+            if (current == tombstone())
+            {
+                if (!reuse)
+                    reuse = &table->slots[s];
+            }
+            else if (current->hash == entry->hash && current->key == entry->key)
+            {
+                table->slots[s].store(entry, std::memory_order_release);
+                if (m_index)
+                    m_index->assign(entry->key, entry);
+                m_memoryUsage.fetch_sub(current->footprint(), std::memory_order_relaxed);
+                m_epochs.retire(current);
+                return log(WalOp::Set, entry->key, entry->bytes(), entry->expiresAt);
+            }
+        }
+
+        shard.live++;
+        if (reuse)
+        {
+            // readers probing for other keys skip entries as they skip tombstones
+            reuse->store(entry, std::memory_order_release);
+        }
+        else
+        {
+            table->slots[s].store(entry, std::memory_order_release);
+            if (++shard.used * 4 > (table->mask + 1) * 3)
+                rebuild(shard);
+        }
+        if (m_index)
+            m_index->assign(entry->key, entry);
+        return log(WalOp::Set, entry->key, entry->bytes(), entry->expiresAt);
+    }
+
+    // Called with the shard lock held: the slot holding `key`, expired or
+    // not, or nullptr.
+    std::atomic<Entry *> *locate(Shard &shard, uint64_t hash, std::string_view key)
+    {
+        Table *table = shard.table.load(std::memory_order_relaxed);
+        for (size_t s = hash & table->mask;; s = (s + 1) & table->mask)
+        {
+            Entry *current = table->slots[s].load(std::memory_order_relaxed);
+            if (!current)
+                return nullptr;
+            if (current != tombstone() && current->hash == hash && current->key == key)
+                return &table->slots[s];
+        }
+    }
+
+    // Applies and logs a Delete like put(); 0 if the key was absent.
+    // `removed` tells whether it was present and not yet expired.
+    uint64_t erase(std::string_view key, bool &removed)
+    {
+        uint64_t hash = hash_of(key);
+        auto &shard = shard_for(hash);
+
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        auto *slot = locate(shard, hash, key);
+        removed = false;
+        if (!slot)
+            return 0;
+        Entry *entry = slot->load(std::memory_order_relaxed);
+        removed = !entry->expired(now_ms());
+        // unlinked before it is logged, as put_locked applies before it
+        // logs: a Delete that lands in the segment a checkpoint drops must
+        // not find the entry still in the snapshot
+        unlink(shard, *slot, entry);
+        return log(WalOp::Delete, key, {});
+    }
+
+    uint64_t erase(std::string_view key)
+    {
+        bool removed;
+        return erase(key, removed);
+    }
+
+    // Called with the shard lock held: tombstones `slot`, which holds `entry`.
+    void unlink(Shard &shard, std::atomic<Entry *> &slot, Entry *entry)
+    {
+        slot.store(tombstone(), std::memory_order_release);
+        if (m_index)
+            m_index->erase(entry->key);
+        m_memoryUsage.fetch_sub(entry->footprint(), std::memory_order_relaxed);
+        m_epochs.retire(entry);
+        shard.live--;
+    }
+
+    uint64_t log(WalOp op, std::string_view key, std::string_view value, uint64_t expiresAt = 0)
+    {
+        return m_durability ? m_durability->wal->append(op, key, value, expiresAt) : 0;
+    }
+
+    // Evicts, once over budget, and waits for a logged change to be
+    // durable, or leaves that to the thread's CommitScope; called after the
+    // shard lock is released.
+    void commit(uint64_t lsn)
+    {
+        enforce_budget();
+        if (lsn && t_commitScope && &t_commitScope->m_store == this)
+            t_commitScope->m_lsn = std::max(t_commitScope->m_lsn, lsn);
+        else
+            wait_durable(lsn);
+    }
+
+    void wait_durable(uint64_t lsn)
+    {
+        if (!lsn)
+            return;
+        auto &d = *m_durability;
+        d.wal->commit(lsn);
+        if (d.options.checkpointBytes && d.wal->bytes() >= d.options.checkpointBytes &&
+            !d.requested.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> guard(d.mutex);
+            d.requested.store(true, std::memory_order_relaxed);
+            d.wake.notify_one();
+        }
+    }
+
+    void checkpoint_loop()
+    {
+        auto &d = *m_durability;
+        std::unique_lock<std::mutex> lock(d.mutex);
+        while (true)
+        {
+            d.wake.wait(lock, [&d]
+                        { return d.stopping || d.requested.load(std::memory_order_relaxed); });
+            if (d.stopping)
+                return;
+            lock.unlock();
+            try
+            {
+                Checkpoint();
+            }
+            catch (const std::runtime_error &)
+            {
+                // the log still has everything; tried again on the next request
+            }
+            lock.lock();
+            d.requested.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void start_sweeper()
+    {
+        std::call_once(m_sweeper.started, [this]
+                       { m_sweeper.thread = std::thread([this]
+                                                        { sweep_loop(); }); });
+    }
+
+    // Every kSweepInterval, runs rounds of kSweepSteps steps over successive
+    // shards, going on while more than a quarter of the entries a round
+    // looked at had expired, for at most a quarter of the interval.
+    void sweep_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_sweeper.mutex);
+        while (!m_sweeper.wake.wait_for(lock, kSweepInterval, [this]
+                                        { return m_sweeper.stopping; }))
+        {
+            lock.unlock();
+            auto deadline = std::chrono::steady_clock::now() + kSweepInterval / 4;
+            size_t examined, expired;
+            do
+            {
+                examined = expired = 0;
+                for (size_t i = 0; i < kSweepSteps; i++)
+                {
+                    auto &shard = m_shards[m_sweeper.nextShard++ & (num_shards() - 1)];
+                    sweep_step(shard, examined, expired);
+                }
+            } while (expired * 4 > examined && std::chrono::steady_clock::now() < deadline);
+            lock.lock();
+        }
+    }
+
+    // Looks at the next kSweepSlots slots of `shard` and removes the
+    // expired entries among them.
+    void sweep_step(Shard &shard, size_t &examined, size_t &expired)
+    {
+        uint64_t now = now_ms();
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        Table *table = shard.table.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kSweepSlots; i++)
+        {
+            auto &slot = table->slots[shard.sweepCursor++ & table->mask];
+            Entry *entry = slot.load(std::memory_order_relaxed);
+            if (!entry || entry == tombstone())
+                continue;
+            examined++;
+            if (entry->expired(now))
+            {
+                // no log record: replay drops expired Sets by itself
+                unlink(shard, slot, entry);
+                expired++;
+                m_expirations.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Evicts from successive shards until usage is back within budget. One
+    // evictor at a time; other writers over budget wait for it.
+    void enforce_budget()
+    {
+        size_t budget = m_memoryBudget.load(std::memory_order_relaxed);
+        if (!budget || m_memoryUsage.load(std::memory_order_relaxed) <= budget)
+            return;
+        std::lock_guard<std::mutex> guard(m_evictMutex);
+        size_t empty = 0;
+        while (m_memoryUsage.load(std::memory_order_relaxed) > budget && empty < num_shards())
+        {
+            auto &shard = m_shards[m_evictShard++ & (num_shards() - 1)];
+            empty = evict_one(shard) ? 0 : empty + 1;
+        }
+    }
+
+    // Advances the shard's CLOCK hand to the first entry that is expired or
+    // not referenced since the last pass, clearing marks on the way, and
+    // evicts it. Two turns at most: after one every mark is clear.
+    bool evict_one(Shard &shard)
+    {
+        uint64_t now = now_ms();
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        Table *table = shard.table.load(std::memory_order_relaxed);
+        for (size_t n = 0; shard.live && n < 2 * (table->mask + 1); n++)
+        {
+            auto &slot = table->slots[shard.clockHand++ & table->mask];
+            Entry *entry = slot.load(std::memory_order_relaxed);
+            if (!entry || entry == tombstone())
+                continue;
+            if (entry->referenced.load(std::memory_order_relaxed) && !entry->expired(now))
+            {
+                entry->referenced.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            // logged, or the key would come back on recovery; unlinked
+            // first, as in erase(), and pinned so the key outlives retire()
+            auto pin = m_epochs.pin();
+            unlink(shard, slot, entry);
+            log(WalOp::Delete, entry->key, {});
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    static std::string wal_path(const std::string &dir, uint64_t id)
+    {
+        return dir + "/wal-" + std::to_string(id) + ".log";
+    }
+
+    static std::string snapshot_path(const std::string &dir, uint64_t id)
+    {
+        return dir + "/snapshot-" + std::to_string(id) + ".kvs";
+    }
+
+    static bool parse_file_name(const std::string &name, std::string_view prefix, std::string_view suffix,
+                                uint64_t &id)
+    {
+        if (name.size() <= prefix.size() + suffix.size() || !name.starts_with(prefix) || !name.ends_with(suffix))
+            return false;
+        auto digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (digits.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        id = std::stoull(digits);
+        return true;
+    }
+
+    // Removes the snapshots and log segments older than checkpoint `id`,
+    // and any snapshot a crash left half written.
+    static void remove_files_before(const std::string &dir, uint64_t id)
+    {
+        for (auto &file : std::filesystem::directory_iterator(dir))
+        {
+            uint64_t n;
+            auto name = file.path().filename().string();
+            if ((parse_file_name(name, "snapshot-", ".kvs", n) && n < id) ||
+                (parse_file_name(name, "wal-", ".log", n) && n < id) || name.ends_with(".kvs.tmp"))
+                std::filesystem::remove(file.path());
+        }
+    }
+
+    // Called with the write lock held once the table is 3/4 full of entries
+    // and tombstones. Copies the entries, not the values, into a table at
+    // most a quarter full, publishes it, and retires the old one; readers
+    // still probing the old table see the same entries there.
+    void rebuild(Shard &shard)
+    {
+        Table *old = shard.table.load(std::memory_order_relaxed);
+        auto *table = new Table(std::max(kMinSlots, std::bit_ceil(shard.live * 4)));
+        for (size_t s = 0; s <= old->mask; s++)
+        {
+            Entry *entry = old->slots[s].load(std::memory_order_relaxed);
+            if (!entry || entry == tombstone())
+                continue;
+            size_t t = entry->hash & table->mask;
+            while (table->slots[t].load(std::memory_order_relaxed))
+                t = (t + 1) & table->mask;
+            table->slots[t].store(entry, std::memory_order_relaxed);
+        }
+        shard.used = shard.live;
+        shard.table.store(table, std::memory_order_release);
+        m_epochs.retire(old);
+    }
+
+    const unsigned m_shardBits;
+    std::unique_ptr<Shard[]> m_shards;
+    EpochDomain &m_epochs;
+    std::unique_ptr<SkipList<Entry>> m_index;  // null unless KeyIndex::Ordered
+    std::unique_ptr<Durability> m_durability; // null for an in-memory store
+
+    std::atomic<size_t> m_memoryUsage{0};
+    std::atomic<size_t> m_memoryBudget{0};
+    std::mutex m_evictMutex;
+    size_t m_evictShard = 0; // under m_evictMutex
+    std::atomic<uint64_t> m_evictions{0};
+    std::atomic<uint64_t> m_expirations{0};
+    Sweeper m_sweeper;
+
+    static inline thread_local CommitScope *t_commitScope = nullptr;
+};
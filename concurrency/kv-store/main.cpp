@@ -1,10 +1,26 @@
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#include "kv_store.h"
 
 using namespace std;
 
-class KVStore
+// ================== Global lock KVStore (baseline) =====================
+// The original design: every operation takes map_mutex before the per-key
+// mutex, so all of them are serialized. Kept as the benchmark baseline.
+class GlobalLockKVStore
 {
 public:
     void Set(const string &key, const string &value)
@@ -42,7 +58,605 @@ private:
     unordered_map<string, string> kv;
 };
 
-int main()
+// ================== Reader/writer locked shards (baseline) =====================
+// One table and shared_mutex per shard. Reads of different keys run in
+// parallel, but every Get still writes the lock's reader count, so readers of
+// the same shard keep stealing its cache line from each other. Range scans
+// walk every shard and sort what they find.
+class SharedMutexKVStore
+{
+public:
+    explicit SharedMutexKVStore(size_t shards = 64) : m_shards(shards) {}
+
+    void Set(const string &key, const string &value)
+    {
+        auto &shard = shard_for(key);
+        unique_lock<shared_mutex> lock(shard.mutex);
+        shard.kv.insert_or_assign(key, value);
+    }
+
+    string Get(const string &key)
+    {
+        auto &shard = shard_for(key);
+        shared_lock<shared_mutex> lock(shard.mutex);
+        auto it = shard.kv.find(key);
+        return it == shard.kv.end() ? string() : it->second;
+    }
+
+    void Delete(const string &key)
+    {
+        auto &shard = shard_for(key);
+        unique_lock<shared_mutex> lock(shard.mutex);
+        shard.kv.erase(key);
+    }
+
+    // Up to `limit` keys in [start, end), in order.
+    vector<pair<string, string>> Scan(const string &start, const string &end, size_t limit)
+    {
+        vector<pair<string, string>> found;
+        for (auto &shard : m_shards)
+        {
+            shared_lock<shared_mutex> lock(shard.mutex);
+            for (auto &[key, value] : shard.kv)
+                if (key >= start && key < end)
+                    found.emplace_back(key, value);
+        }
+        sort(found.begin(), found.end());
+        found.resize(min(found.size(), limit));
+        return found;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        shared_mutex mutex;
+        unordered_map<string, string> kv;
+    };
+
+    Shard &shard_for(const string &key)
+    {
+        return m_shards[(hash<string>{}(key) * 0x9E3779B97F4A7C15ull >> 32) % m_shards.size()];
+    }
+
+    vector<Shard> m_shards;
+};
+
+// ================== Benchmark =====================
+// `threads` threads share `totalOps` operations on a preloaded keyspace,
+// `readPercent` of them Get and the rest Set, on keys drawn uniformly.
+// Reports operations per second.
+template <typename Store>
+double ops_per_second(Store &store, int threads, int totalOps, int readPercent)
+{
+    constexpr int keys = 100'000;
+    static vector<string> keyNames = []
+    {
+        vector<string> names;
+        for (int i = 0; i < keys; i++)
+            names.push_back("key:" + to_string(i));
+        return names;
+    }();
+    for (auto &key : keyNames)
+        store.Set(key, "initial-value");
+
+    atomic<bool> go{false};
+    atomic<size_t> sink{0};
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+                                 uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1);
+                                 size_t bytes = 0;
+                                 string value = "value-" + to_string(t);
+                                 while (!go.load(memory_order_acquire))
+                                     this_thread::yield();
+                                 for (int i = 0; i < totalOps / threads; i++)
+                                 {
+                                     // xorshift, so the benchmark doesn't measure the RNG
+                                     rng ^= rng << 13;
+                                     rng ^= rng >> 7;
+                                     rng ^= rng << 17;
+                                     auto &key = keyNames[rng % keys];
+                                     if (static_cast<int>((rng >> 32) % 100) < readPercent)
+                                         bytes += store.Get(key).size();
+                                     else
+                                         store.Set(key, value);
+                                 }
+                                 sink.fetch_add(bytes, memory_order_relaxed); });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go.store(true, memory_order_release);
+    for (auto &w : workers)
+        w.join();
+    auto end = chrono::steady_clock::now();
+    return static_cast<double>(totalOps / threads * threads) / chrono::duration<double>(end - start).count();
+}
+
+// ================== Durability benchmark =====================
+// `writers` threads each make `perWriter` durable Sets to their own keys;
+// reports committed Sets per second and how many fsyncs the log issued.
+struct CommitResult
+{
+    double commitsPerSec;
+    uint64_t syncs;
+};
+
+CommitResult commit_throughput(const string &dir, SyncMode mode, int writers, int perWriter)
+{
+    filesystem::remove_all(dir);
+    DurabilityOptions options;
+    options.sync = mode;
+    KVStore store(dir, options);
+
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int w = 0; w < writers; w++)
+    {
+        threads.emplace_back([&store, w, perWriter]
+                             {
+                                 string value(100, 'v');
+                                 for (int i = 0; i < perWriter; i++)
+                                     store.Set("writer" + to_string(w) + ":" + to_string(i), value); });
+    }
+    for (auto &t : threads)
+        t.join();
+    auto end = chrono::steady_clock::now();
+    return {writers * perWriter / chrono::duration<double>(end - start).count(), store.log_syncs()};
+}
+
+// Fills a durable store, checkpoints it, logs some more changes on top, and
+// times how long reopening takes: snapshot load plus log replay.
+void recovery_demo(const string &dir, int keys)
+{
+    filesystem::remove_all(dir);
+    DurabilityOptions options;
+    options.checkpointBytes = 0; // checkpoint by hand below
+    {
+        KVStore store(dir, options);
+        // concurrent loaders, so the group commit batches the initial fill
+        vector<thread> loaders;
+        for (int l = 0; l < 8; l++)
+            loaders.emplace_back([&store, l, keys]
+                                 {
+                                     string value(100, 'v');
+                                     for (int i = l; i < keys; i += 8)
+                                         store.Set("key:" + to_string(i), value); });
+        for (auto &t : loaders)
+            t.join();
+        auto start = chrono::steady_clock::now();
+        store.Checkpoint();
+        auto end = chrono::steady_clock::now();
+        cout << "\ncheckpoint of " << keys << " keys: " << chrono::duration<double, milli>(end - start).count()
+             << "ms\n";
+
+        for (int i = 0; i < 1000; i++)
+            store.Set("key:" + to_string(i), "updated");
+        store.Delete("key:1");
+    }
+
+    uintmax_t snapshotBytes = 0, logBytes = 0;
+    for (auto &file : filesystem::directory_iterator(dir))
+        (file.path().extension() == ".kvs" ? snapshotBytes : logBytes) += file.file_size();
+
+    auto start = chrono::steady_clock::now();
+    KVStore store(dir, options);
+    auto end = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(end - start).count();
+    cout << "recovered " << store.Size() << " keys from a " << snapshotBytes / (1 << 20) << "MB snapshot and a "
+         << logBytes / 1024 << "KB log in " << ms << "ms (" << snapshotBytes / (1 << 20) / (ms / 1000)
+         << "MB/s); key:0 = " << store.Get("key:0") << ", key:1 = \"" << store.Get("key:1") << "\"\n";
+}
+
+// Deletes every key of a durable store from several threads while another
+// checkpoints over and over until half are gone, then reopens it. A Delete
+// logged into a segment that a checkpoint drops must already be missing
+// from that checkpoint's snapshot, or the key comes back: the last
+// checkpoint overlaps Deletes, so no later one covers for it.
+void checkpoint_delete_check(const string &dir, int keys)
+{
+    filesystem::remove_all(dir);
+    DurabilityOptions options;
+    options.checkpointBytes = 0;
+    int checkpoints = 0;
+    {
+        KVStore store(dir, options);
+        vector<pair<string, string>> fill;
+        for (int i = 0; i < keys; i++)
+            fill.push_back({"key:" + to_string(i), "v"});
+        store.MultiSet(fill);
+
+        atomic<int> deleted{0};
+        thread checkpointer([&]
+                            {
+                                while (deleted.load() < keys / 2)
+                                {
+                                    store.Checkpoint();
+                                    checkpoints++;
+                                } });
+        vector<thread> deleters;
+        for (int d = 0; d < 4; d++)
+            deleters.emplace_back([&store, &deleted, d, keys]
+                                  {
+                                      for (int i = d; i < keys; i += 4)
+                                      {
+                                          store.Delete("key:" + to_string(i));
+                                          deleted++;
+                                      } });
+        for (auto &t : deleters)
+            t.join();
+        checkpointer.join();
+    }
+    KVStore store(dir, options);
+    cout << "deleted " << keys << " keys during " << checkpoints << " checkpoints; after reopening "
+         << store.Size() << " are back (expected 0)\n";
+}
+
+// ================== Cache behaviour =====================
+// Half the keys get a short TTL; reports how many reads still see them and
+// how the sweeper shrinks the store in the background.
+void ttl_demo()
+{
+    constexpr int keys = 200'000;
+    KVStore store;
+    for (int i = 0; i < keys; i++)
+    {
+        if (i % 2)
+            store.Set("key:" + to_string(i), "short lived", chrono::milliseconds(200));
+        else
+            store.Set("key:" + to_string(i), "permanent");
+    }
+
+    auto visible = [&store]
+    {
+        int n = 0;
+        for (int i = 0; i < keys; i++)
+            n += !store.Get("key:" + to_string(i)).empty();
+        return n;
+    };
+    cout << "\n"
+         << keys << " keys, half with a 200ms TTL\n";
+    auto start = chrono::steady_clock::now();
+    for (int ms : {0, 300, 600, 1000})
+    {
+        this_thread::sleep_until(start + chrono::milliseconds(ms));
+        cout << "after " << ms << "ms: " << visible() << " readable, " << store.Size() << " stored, "
+             << store.expirations() << " swept\n";
+    }
+}
+
+// Reads from a 1M key space, 90% of them to the hottest 10% of the keys,
+// filling misses with a Set, against a memory budget that fits about a
+// fifth of the keys. Reports the hit rate and the Get rate.
+void budget_demo(int threads)
+{
+    constexpr int keys = 1'000'000;
+    constexpr int readsPerThread = 1'000'000;
+    const string value(64, 'v');
+
+    KVStore store;
+    store.Set("probe", value);
+    size_t perKey = store.memory_usage();
+    store.Delete("probe");
+    size_t budget = perKey * keys / 5;
+    store.set_memory_budget(budget);
+
+    atomic<uint64_t> hits{0};
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+                                 uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1), local = 0;
+                                 for (int i = 0; i < readsPerThread; i++)
+                                 {
+                                     rng ^= rng << 13;
+                                     rng ^= rng >> 7;
+                                     rng ^= rng << 17;
+                                     uint64_t k = (rng >> 32) % 10 ? rng % (keys / 10) : rng % keys;
+                                     auto key = "key:" + to_string(k);
+                                     if (!store.Get(key).empty())
+                                         local++;
+                                     else
+                                         store.Set(key, value);
+                                 }
+                                 hits.fetch_add(local, memory_order_relaxed); });
+    }
+    for (auto &w : workers)
+        w.join();
+    auto end = chrono::steady_clock::now();
+
+    double reads = static_cast<double>(threads) * readsPerThread;
+    cout << "\nbudget " << budget / (1 << 20) << "MB (~" << keys / 5 << " of " << keys << " keys), " << threads
+         << " threads: hit rate " << hits.load() / reads * 100 << "% (hot set is 10% of keys, 90% of reads), "
+         << reads / chrono::duration<double>(end - start).count() << " reads/s, usage "
+         << store.memory_usage() / (1 << 20) << "MB, " << store.Size() << " keys, " << store.evictions()
+         << " evictions\n";
+}
+
+// ================== Batched operations =====================
+// `threads` clients each send `requests` requests touching `batch` random
+// keys of a preloaded store, either one call per key or one Multi call per
+// request. Reports requests per second.
+template <bool Batched, bool Write>
+double requests_per_second(KVStore &store, int threads, int requests, int batch)
+{
+    constexpr int keys = 100'000;
+    atomic<size_t> sink{0};
+    vector<thread> clients;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        clients.emplace_back([&store, &sink, t, requests, batch]
+                             {
+                                 uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1);
+                                 size_t bytes = 0;
+                                 vector<string> names(batch);
+                                 vector<pair<string, string>> items(batch);
+                                 for (int r = 0; r < requests; r++)
+                                 {
+                                     for (int k = 0; k < batch; k++)
+                                     {
+                                         rng ^= rng << 13;
+                                         rng ^= rng >> 7;
+                                         rng ^= rng << 17;
+                                         names[k] = "key:" + to_string(rng % keys);
+                                         items[k] = {names[k], "value-" + to_string(r)};
+                                     }
+                                     if constexpr (Write && Batched)
+                                         store.MultiSet(items);
+                                     else if constexpr (Write)
+                                         for (auto &[key, value] : items)
+                                             store.Set(key, value);
+                                     else if constexpr (Batched)
+                                         for (auto &value : store.MultiGet(names))
+                                             bytes += value.size();
+                                     else
+                                         for (auto &key : names)
+                                             bytes += store.Get(key).size();
+                                 }
+                                 sink.fetch_add(bytes, memory_order_relaxed); });
+    }
+    for (auto &c : clients)
+        c.join();
+    auto end = chrono::steady_clock::now();
+    return threads * requests / chrono::duration<double>(end - start).count();
+}
+
+void batch_benchmark(const string &dir)
+{
+    constexpr int threads = 4;
+    constexpr int batch = 100;
+
+    KVStore memory;
+    vector<pair<string, string>> fill;
+    for (int i = 0; i < 100'000; i++)
+        fill.push_back({"key:" + to_string(i), "initial-value"});
+    memory.MultiSet(fill);
+
+    cout << "\n"
+         << threads << " clients, " << batch << " keys per request, requests/s\n";
+    cout << "                     per key     Multi\n";
+    cout << "Get, in memory       " << requests_per_second<false, false>(memory, threads, 5'000, batch) << "\t    "
+         << requests_per_second<true, false>(memory, threads, 5'000, batch) << "\n";
+    cout << "Set, in memory       " << requests_per_second<false, true>(memory, threads, 5'000, batch) << "\t    "
+         << requests_per_second<true, true>(memory, threads, 5'000, batch) << "\n";
+    filesystem::remove_all(dir);
+    {
+        KVStore durable(dir);
+        cout << "Set, durable         " << requests_per_second<false, true>(durable, threads, 20, batch) << "\t    "
+             << requests_per_second<true, true>(durable, threads, 200, batch) << "\n";
+    }
+    filesystem::remove_all(dir);
+
+    // read-modify-write without external locking
+    KVStore counters;
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&counters]
+                             {
+                                 for (int i = 0; i < 10'000; i++)
+                                 {
+                                     counters.Increment("hits");
+                                     string seen;
+                                     do
+                                         seen = counters.Get("cas");
+                                     while (!counters.CompareAndSet("cas", seen, to_string(seen.empty() ? 1 : stoi(seen) + 1)));
+                                 } });
+    for (auto &w : workers)
+        w.join();
+    cout << "after " << threads << " x 10000: Increment counter = " << counters.Get("hits")
+         << ", CompareAndSet counter = " << counters.Get("cas") << "\n";
+}
+
+// ================== Large values =====================
+// Get cost by value size: taking a Value handle, copying the bytes out of
+// it, and lending them to Read(). `threads` readers share 64 keys.
+void value_size_benchmark(int threads)
+{
+    constexpr int keys = 64;
+    constexpr int readsPerThread = 200'000;
+
+    cout << "\n"
+         << threads << " readers, wall time per read in ns\n";
+    cout << "value size  Get handle  Get + copy  Read\n";
+    for (size_t size : {size_t{10}, size_t{1} << 10, size_t{1} << 20})
+    {
+        KVStore store;
+        for (int k = 0; k < keys; k++)
+            store.Set("key:" + to_string(k), string(size, 'v'));
+
+        auto measure = [&](int mode)
+        {
+            atomic<size_t> sink{0};
+            vector<thread> readers;
+            // copies of a 1MB value take long enough with fewer reads
+            int reads = mode == 1 && size > 1024 ? readsPerThread / 100 : readsPerThread;
+            auto start = chrono::steady_clock::now();
+            for (int t = 0; t < threads; t++)
+                readers.emplace_back([&store, &sink, mode, reads, t]
+                                     {
+                                         size_t bytes = 0;
+                                         string key;
+                                         for (int i = 0; i < reads; i++)
+                                         {
+                                             key = "key:" + to_string((i + t) % keys);
+                                             if (mode == 0)
+                                                 bytes += store.Get(key).size();
+                                             else if (mode == 1)
+                                                 bytes += store.Get(key).str().size();
+                                             else
+                                                 store.Read(key, [&bytes](string_view v)
+                                                            { bytes += v.size(); });
+                                         }
+                                         sink.fetch_add(bytes, memory_order_relaxed); });
+            for (auto &r : readers)
+                r.join();
+            auto end = chrono::steady_clock::now();
+            return chrono::duration<double, nano>(end - start).count() / (static_cast<double>(threads) * reads);
+        };
+        cout << size << "\t    " << measure(0) << "\t" << measure(1) << "\t    " << measure(2) << "\n";
+    }
+}
+
+// ================== Ordered index =====================
+// `threads` threads each run `perThread` calls of op(rng), op drawing its
+// keys from the xorshift state it is given. Reports calls per second.
+template <typename Op>
+double calls_per_second(int threads, int perThread, Op op)
+{
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&op, t, perThread]
+                             {
+                                 uint64_t rng = 0x9E3779B97F4A7C15ull * (t + 1);
+                                 for (int i = 0; i < perThread; i++)
+                                 {
+                                     rng ^= rng << 13;
+                                     rng ^= rng >> 7;
+                                     rng ^= rng << 17;
+                                     op(rng);
+                                 } });
+    for (auto &w : workers)
+        w.join();
+    auto end = chrono::steady_clock::now();
+    return static_cast<double>(threads) * perThread / chrono::duration<double>(end - start).count();
+}
+
+// Point lookups and 100-key range scans on 200k keys: the hash-only store,
+// the store with its ordered index, and the skiplist alone; scans against
+// the shard-walk-and-sort baseline. Then scans while writers insert and
+// delete around them, checking every result is in order.
+void ordered_benchmark(int threads)
+{
+    constexpr int keys = 200'000;
+    constexpr int scanLength = 100;
+    auto name = [](uint64_t i)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "key:%07llu", static_cast<unsigned long long>(i));
+        return string(buf);
+    };
+
+    KVStore hashed;
+    KVStore ordered(64, KeyIndex::Ordered);
+    SharedMutexKVStore baseline;
+    SkipList<string> list;
+    vector<string> values(keys, "value");
+    for (int i = 0; i < keys; i++)
+    {
+        baseline.Set(name(i), "value");
+        list.assign(name(i), &values[i]);
+    }
+
+    cout << "\n"
+         << keys << " keys, " << threads << " threads, calls/s\n";
+    cout << "                 hash      ordered   skiplist  shard walk + sort\n";
+    cout << "Set (load)       "
+         << calls_per_second(1, keys, [&, i = 0](uint64_t) mutable
+                             { hashed.Set(name(i++), "value"); })
+         << "\t  "
+         << calls_per_second(1, keys, [&, i = 0](uint64_t) mutable
+                             { ordered.Set(name(i++), "value"); })
+         << "\n";
+    cout << "Set (overwrite)  "
+         << calls_per_second(threads, 200'000, [&](uint64_t rng)
+                             { hashed.Set(name(rng % keys), "value"); })
+         << "\t  "
+         << calls_per_second(threads, 200'000, [&](uint64_t rng)
+                             { ordered.Set(name(rng % keys), "value"); })
+         << "\n";
+    atomic<size_t> sink{0};
+    cout << "Get              "
+         << calls_per_second(threads, 200'000, [&](uint64_t rng)
+                             { sink.fetch_add(hashed.Get(name(rng % keys)).size(), memory_order_relaxed); })
+         << "\t  "
+         << calls_per_second(threads, 200'000, [&](uint64_t rng)
+                             { sink.fetch_add(ordered.Get(name(rng % keys)).size(), memory_order_relaxed); })
+         << "\t    "
+         << calls_per_second(threads, 200'000, [&](uint64_t rng)
+                             {
+                                 auto guard = EpochDomain::getInstance().pin();
+                                 sink.fetch_add(list.find(name(rng % keys))->size(), memory_order_relaxed); })
+         << "\n";
+    cout << "Scan of " << scanLength << "\t\t\t  "
+         << calls_per_second(threads, 20'000, [&](uint64_t rng)
+                             {
+                                 uint64_t first = rng % keys;
+                                 sink.fetch_add(ordered.Scan(name(first), name(first + scanLength)).size(),
+                                                memory_order_relaxed); })
+         << "\t\t      "
+         << calls_per_second(threads, 20, [&](uint64_t rng)
+                             {
+                                 uint64_t first = rng % keys;
+                                 sink.fetch_add(baseline.Scan(name(first), name(first + scanLength), scanLength).size(),
+                                                memory_order_relaxed); })
+         << "\n";
+
+    // writers add and remove the odd keys past the loaded range while
+    // readers scan prefixes of it; the even ones stay put throughout
+    for (int i = keys; i < 2 * keys; i += 2)
+        ordered.Set(name(i), "stable");
+    atomic<bool> stop{false};
+    vector<thread> writers;
+    int stride = 2 * max(threads / 2, 1);
+    for (int w = 0; w < stride / 2; w++)
+        writers.emplace_back([&, w]
+                             {
+                                 // each writer keeps about 500 keys of its own set at a time
+                                 for (int i = keys + 1 + 2 * w; !stop.load(memory_order_relaxed); i += stride)
+                                 {
+                                     if (i >= 2 * keys)
+                                         i = keys + 1 + 2 * w;
+                                     ordered.Set(name(i), "churn");
+                                     ordered.Delete(name(i >= keys + 1000 ? i - 1000 : i + keys - 1000));
+                                 } });
+    atomic<int> broken{0};
+    double scans = calls_per_second(threads, 2'000, [&](uint64_t rng)
+                                    {
+                                        // a prefix covering 1000 keys of the second half
+                                        auto prefix = name(keys + rng % keys).substr(0, 8);
+                                        auto found = ordered.ScanPrefix(prefix);
+                                        size_t stable = 0;
+                                        for (size_t i = 0; i < found.size(); i++)
+                                        {
+                                            if ((i && found[i - 1].first >= found[i].first) || !found[i].first.starts_with(prefix))
+                                                broken.fetch_add(1);
+                                            stable += found[i].second == "stable";
+                                        }
+                                        if (stable != 500)
+                                            broken.fetch_add(1); });
+    stop.store(true);
+    for (auto &w : writers)
+        w.join();
+    cout << "ScanPrefix of 1000 keys under " << writers.size() << " writers: " << scans << " scans/s, "
+         << (broken.load() ? "INCONSISTENT" : "every result in order with all stable keys") << "\n";
+}
+
+int main(int argc, char **argv)
 {
     KVStore store;
 
@@ -74,5 +688,45 @@ int main()
     t3.join();
     t4.join();
 
+    int totalOps = argc > 1 ? stoi(argv[1]) : 1'000'000;
+    for (int readPercent : {98, 90, 50})
+    {
+        cout << "\n"
+             << readPercent << "% Get / " << 100 - readPercent << "% Set, 100k keys, 64 shards, ops/s\n";
+        cout << "threads  global lock  shared_mutex  lock-free reads\n";
+        for (int threads = 1; threads <= 32; threads *= 2)
+        {
+            GlobalLockKVStore global;
+            SharedMutexKVStore locked(64);
+            KVStore store(64);
+            double g = ops_per_second(global, threads, totalOps, readPercent);
+            double l = ops_per_second(locked, threads, totalOps, readPercent);
+            double f = ops_per_second(store, threads, totalOps, readPercent);
+            cout << threads << "\t " << g << "\t      " << l << "\t    " << f << "\n";
+        }
+    }
+
+    string dir = (filesystem::temp_directory_path() / "kvstore-bench").string();
+    constexpr int perWriter = 200;
+    cout << "\ndurable Sets, " << perWriter << " per writer, 100 byte values\n";
+    cout << "writers  fsync per write  fsyncs   group commit  fsyncs\n";
+    for (int writers = 1; writers <= 32; writers *= 2)
+    {
+        auto single = commit_throughput(dir, SyncMode::PerWrite, writers, perWriter);
+        auto group = commit_throughput(dir, SyncMode::Group, writers, perWriter);
+        cout << writers << "\t " << single.commitsPerSec << "\t\t  " << single.syncs << "\t   "
+             << group.commitsPerSec << "\t  " << group.syncs << "\n";
+    }
+
+    recovery_demo(dir, argc > 2 ? stoi(argv[2]) : 1'000'000);
+    checkpoint_delete_check(dir, 20'000);
+    filesystem::remove_all(dir);
+
+    batch_benchmark(dir);
+    value_size_benchmark(4);
+    ordered_benchmark(4);
+    ttl_demo();
+    budget_demo(4);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+
+#include "epoch.h"
+
+// ================== Concurrent skiplist =====================
+// A sorted map from string keys to T*, in byte order, that readers search
+// and iterate without locks while writers change it.
+//
+// Every node is linked at level 0 and, with probability 1/4 per level, at
+// the levels above, so a search skips ahead along the upper levels and
+// drops down one level at a time. A node's links are filled in before it is
+// published, bottom level first, so a reader finds a node either not yet at
+// all or fully formed; a removed node keeps its links, so a reader standing
+// on it still walks on to keys after it. Removed nodes go to the
+// EpochDomain, which frees them once no reader can still be standing there.
+//
+// Replacing the value of a key already present is a single atomic store.
+// Linking and unlinking nodes takes an internal lock, so writers of
+// different keys only wait for each other when they change the structure.
+// Writers of the same key must be serialized by the caller. The list does
+// not own the values: whoever replaces or erases one retires it.
+template <typename T>
+class SkipList
+{
+    struct Node;
+
+public:
+    // with branching factor 4, enough for about 4^kMaxHeight keys
+    static constexpr unsigned kMaxHeight = 16;
+
+    // A position in the list. Only valid inside the epoch guard it was
+    // obtained under.
+    class Iterator
+    {
+    public:
+        bool valid() const
+        {
+            return m_node != nullptr;
+        }
+
+        std::string_view key() const
+        {
+            return m_node->key;
+        }
+
+        T *value() const
+        {
+            return m_node->value.load(std::memory_order_acquire);
+        }
+
+        void next()
+        {
+            m_node = m_node->next(0);
+        }
+
+    private:
+        friend class SkipList;
+
+        explicit Iterator(const Node *node) : m_node(node) {}
+
+        const Node *m_node;
+    };
+
+    SkipList() : m_head(Node::create({}, nullptr, kMaxHeight)), m_epochs(EpochDomain::getInstance()) {}
+
+    // Frees the nodes, not the values.
+    ~SkipList()
+    {
+        for (Node *node = m_head; node;)
+        {
+            Node *next = node->next(0);
+            Node::destroy(node);
+            node = next;
+        }
+    }
+
+    SkipList(const SkipList &) = delete;
+    SkipList &operator=(const SkipList &) = delete;
+
+    // Must be called inside an epoch guard; nullptr if the key is absent.
+    T *find(std::string_view key) const
+    {
+        const Node *node = lower_bound(key, nullptr);
+        return node && node->key == key ? node->value.load(std::memory_order_acquire) : nullptr;
+    }
+
+    // Must be called inside an epoch guard: the first key not less than
+    // `key`.
+    Iterator seek(std::string_view key) const
+    {
+        return Iterator(lower_bound(key, nullptr));
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(m_head->next(0));
+    }
+
+    // Inserts `key`, or replaces its value.
+    void assign(std::string_view key, T *value)
+    {
+        auto guard = m_epochs.pin();
+        if (Node *node = lower_bound(key, nullptr); node && node->key == key)
+        {
+            node->value.store(value, std::memory_order_release);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        Node *prev[kMaxHeight];
+        lower_bound(key, prev);
+        unsigned height = random_height();
+        if (height > m_height.load(std::memory_order_relaxed))
+        {
+            for (unsigned level = m_height.load(std::memory_order_relaxed); level < height; level++)
+                prev[level] = m_head;
+            // a reader that sees the new height before the node just finds
+            // the head's upper links empty
+            m_height.store(height, std::memory_order_relaxed);
+        }
+        Node *node = Node::create(key, value, height);
+        for (unsigned level = 0; level < height; level++)
+        {
+            node->links()[level].store(prev[level]->next(level), std::memory_order_relaxed);
+            prev[level]->links()[level].store(node, std::memory_order_release);
+        }
+        m_size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Unlinks `key`. Returns false if it was absent.
+    bool erase(std::string_view key)
+    {
+        auto guard = m_epochs.pin();
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        Node *prev[kMaxHeight];
+        Node *node = lower_bound(key, prev);
+        if (!node || node->key != key)
+            return false;
+        // top down, so the node leaves the fast lanes before level 0
+        for (unsigned level = node->height; level-- > 0;)
+            prev[level]->links()[level].store(node->next(level), std::memory_order_release);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        m_epochs.retire(node, [](void *p)
+                        { Node::destroy(static_cast<Node *>(p)); });
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Node
+    {
+        const std::string key;
+        std::atomic<T *> value;
+        const unsigned height;
+
+        // the links follow the node in the same allocation, height of them
+        std::atomic<Node *> *links()
+        {
+            return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+        }
+
+        Node *next(unsigned level) const
+        {
+            return const_cast<Node *>(this)->links()[level].load(std::memory_order_acquire);
+        }
+
+        static Node *create(std::string_view key, T *value, unsigned height)
+        {
+            void *memory = ::operator new(sizeof(Node) + height * sizeof(std::atomic<Node *>));
+            auto *node = new (memory) Node{std::string(key), value, height};
+            for (unsigned level = 0; level < height; level++)
+                new (&node->links()[level]) std::atomic<Node *>(nullptr);
+            return node;
+        }
+
+        static void destroy(Node *node)
+        {
+            node->~Node();
+            ::operator delete(node);
+        }
+    };
+
+    // The first node whose key is not less than `key`, or nullptr. If
+    // `prev` is given, fills in the last node before it at every level.
+    Node *lower_bound(std::string_view key, Node **prev) const
+    {
+        Node *node = m_head;
+        unsigned level = m_height.load(std::memory_order_relaxed);
+        while (level-- > 0)
+        {
+            Node *next = node->next(level);
+            while (next && std::string_view(next->key) < key)
+            {
+                node = next;
+                next = node->next(level);
+            }
+            if (prev)
+                prev[level] = node;
+            if (level == 0)
+                return next;
+        }
+        return nullptr;
+    }
+
+    // Called with the write lock held.
+    unsigned random_height()
+    {
+        // xorshift; two bits per level for the 1/4 chance of going up
+        m_rng ^= m_rng << 13;
+        m_rng ^= m_rng >> 7;
+        m_rng ^= m_rng << 17;
+        unsigned height = 1;
+        for (uint64_t bits = m_rng; height < kMaxHeight && (bits & 3) == 0; bits >>= 2)
+            height++;
+        return height;
+    }
+
+    Node *const m_head;
+    EpochDomain &m_epochs;
+    std::atomic<unsigned> m_height{1};
+    std::atomic<size_t> m_size{0};
+
+    std::mutex m_writeMutex;
+    uint64_t m_rng = 0x9E3779B97F4A7C15ull;
+};
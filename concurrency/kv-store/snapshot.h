@@ -0,0 +1,220 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wal.h"
+
+// ================== Snapshots =====================
+// A compacted image of the store: every live key once, no history.
+//
+// Layout: magic u64 | section count u64 | per section {offset u64, bytes
+// u64, records u64, checksum u64} | section data, where each section is a
+// run of key length u32 | value length u32 | expiry u64 | key | value
+// records, the expiry in ms since the Unix epoch or 0 for never. The
+// loader also reads KVSNAP01 files, whose records have no expiry field and
+// never expire. The writer makes one section per store shard, so a loader can verify and
+// insert the sections on separate threads without their keys contending
+// for the same shard lock.
+//
+// The writer goes to `<path>.tmp` and only renames it into place once it
+// is fully on disk, so a crash mid-snapshot leaves the previous one intact.
+class SnapshotWriter
+{
+public:
+    static constexpr uint64_t kMagic = 0x323050414E53564Bull;   // "KVSNAP02"
+    static constexpr uint64_t kMagicV1 = 0x313050414E53564Bull; // "KVSNAP01", no expiry
+    static constexpr size_t kHeaderBytes = 16;
+
+    SnapshotWriter(std::string path, size_t sections)
+        : m_path(std::move(path)), m_tmpPath(m_path + ".tmp"), m_file(m_tmpPath.c_str(), "wb"),
+          m_table(sections)
+    {
+        // the table is filled in by finish(); leave room for it
+        std::vector<char> header(kHeaderBytes + sections * 32);
+        write(header.data(), header.size());
+    }
+
+    // Adds a record to the current section.
+    void add(std::string_view key, std::string_view value, uint64_t expiresAt = 0)
+    {
+        kvdisk::put_u32(m_section, static_cast<uint32_t>(key.size()));
+        kvdisk::put_u32(m_section, static_cast<uint32_t>(value.size()));
+        kvdisk::put_u64(m_section, expiresAt);
+        m_section.insert(m_section.end(), key.begin(), key.end());
+        m_section.insert(m_section.end(), value.begin(), value.end());
+        m_records++;
+    }
+
+    // Closes the current section; the next add() starts the following one.
+    void end_section()
+    {
+        if (m_current >= m_table.size())
+            throw std::logic_error("SnapshotWriter: more sections than declared");
+        m_table[m_current++] = {m_offset, m_section.size(), m_records,
+                                kvdisk::checksum(m_section.data(), m_section.size())};
+        write(m_section.data(), m_section.size());
+        m_section.clear();
+        m_records = 0;
+    }
+
+    // Writes the section table, syncs, and atomically replaces `path`.
+    void finish(const std::string &dir)
+    {
+        while (m_current < m_table.size())
+            end_section();
+
+        std::vector<char> header;
+        kvdisk::put_u64(header, kMagic);
+        kvdisk::put_u64(header, m_table.size());
+        for (auto &s : m_table)
+        {
+            kvdisk::put_u64(header, s.offset);
+            kvdisk::put_u64(header, s.bytes);
+            kvdisk::put_u64(header, s.records);
+            kvdisk::put_u64(header, s.checksum);
+        }
+        FILE *f = m_file.get();
+        if (std::fseek(f, 0, SEEK_SET) != 0 || std::fwrite(header.data(), 1, header.size(), f) != header.size() ||
+            std::fflush(f) != 0 || ::fsync(fileno(f)) != 0)
+            throw std::runtime_error("writing " + m_tmpPath + " failed: " + strerror(errno));
+        if (std::rename(m_tmpPath.c_str(), m_path.c_str()) != 0)
+            throw std::runtime_error("rename(" + m_tmpPath + ") failed: " + strerror(errno));
+        kvdisk::sync_directory(dir);
+    }
+
+    size_t bytes() const
+    {
+        return m_offset;
+    }
+
+private:
+    struct Section
+    {
+        uint64_t offset;
+        uint64_t bytes;
+        uint64_t records;
+        uint64_t checksum;
+    };
+
+    void write(const char *data, size_t len)
+    {
+        if (std::fwrite(data, 1, len, m_file.get()) != len)
+            throw std::runtime_error("writing " + m_tmpPath + " failed: " + strerror(errno));
+        m_offset += len;
+    }
+
+    const std::string m_path;
+    const std::string m_tmpPath;
+    FileRAII m_file;
+    std::vector<Section> m_table;
+    size_t m_current = 0;
+    uint64_t m_offset = 0;
+    std::vector<char> m_section;
+    uint64_t m_records = 0;
+};
+
+// Maps the snapshot at `path` and calls apply(key, value, expiresAt) for
+// every record, from up to `threads` threads at once, one section per
+// thread at a time. The views point into the mapping and are only valid
+// during the call.
+// Returns the number of records. Throws std::runtime_error if the file is
+// damaged, before or after applying some of it.
+template <typename Apply>
+size_t load_snapshot(const std::string &path, Apply &&apply, unsigned threads = std::thread::hardware_concurrency())
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("open(" + path + ") failed: " + strerror(errno));
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("fstat(" + path + ") failed: " + strerror(errno));
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *map = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("mmap(" + path + ") failed: " + strerror(errno));
+    // start reading the whole file ahead while the first sections parse
+    ::madvise(map, size, MADV_WILLNEED);
+
+    struct Unmap
+    {
+        void *map;
+        size_t size;
+        ~Unmap() { ::munmap(map, size); }
+    } unmap{map, size};
+
+    const char *base = static_cast<const char *>(map);
+    constexpr size_t kHeader = SnapshotWriter::kHeaderBytes;
+    uint64_t magic = size < kHeader ? 0 : kvdisk::get_u64(base);
+    if (magic != SnapshotWriter::kMagic && magic != SnapshotWriter::kMagicV1)
+        throw std::runtime_error("snapshot " + path + " has a bad header");
+    const size_t recordHeader = magic == SnapshotWriter::kMagic ? 16 : 8;
+    size_t sections = kvdisk::get_u64(base + 8);
+    if (sections > (size - kHeader) / 32)
+        throw std::runtime_error("snapshot " + path + " has a bad section table");
+
+    std::atomic<size_t> nextSection{0};
+    std::atomic<size_t> records{0};
+    std::atomic<bool> damaged{false};
+    auto worker = [&]
+    {
+        size_t s;
+        while ((s = nextSection.fetch_add(1, std::memory_order_relaxed)) < sections && !damaged.load())
+        {
+            const char *entry = base + kHeader + s * 32;
+            uint64_t offset = kvdisk::get_u64(entry), bytes = kvdisk::get_u64(entry + 8);
+            if (offset > size || bytes > size - offset ||
+                kvdisk::checksum(base + offset, bytes) != kvdisk::get_u64(entry + 24))
+            {
+                damaged.store(true);
+                return;
+            }
+            const char *p = base + offset, *end = p + bytes;
+            size_t n = 0;
+            while (static_cast<size_t>(end - p) >= recordHeader)
+            {
+                size_t keyLen = kvdisk::get_u32(p), valueLen = kvdisk::get_u32(p + 4);
+                if (keyLen + valueLen > static_cast<size_t>(end - p) - recordHeader)
+                    break;
+                const char *key = p + recordHeader;
+                apply(std::string_view(key, keyLen), std::string_view(key + keyLen, valueLen),
+                      recordHeader == 16 ? kvdisk::get_u64(p + 8) : 0);
+                p = key + keyLen + valueLen;
+                n++;
+            }
+            if (p != end || n != kvdisk::get_u64(entry + 16))
+                damaged.store(true);
+            records.fetch_add(n, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    unsigned helpers = std::min<size_t>(std::max(threads, 1u), std::max<size_t>(sections, 1)) - 1;
+    for (unsigned t = 0; t < helpers; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+        t.join();
+
+    if (damaged.load())
+        throw std::runtime_error("snapshot " + path + " is damaged");
+    return records.load();
+}
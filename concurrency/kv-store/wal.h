@@ -0,0 +1,332 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../../raii/file-raii/file_raii.h"
+
+// ================== On-disk encoding =====================
+// Integers are stored in host byte order; the files are not meant to move
+// between machines.
+namespace kvdisk
+{
+    inline void put_u32(std::vector<char> &out, uint32_t v)
+    {
+        out.insert(out.end(), reinterpret_cast<const char *>(&v), reinterpret_cast<const char *>(&v) + 4);
+    }
+
+    inline void put_u64(std::vector<char> &out, uint64_t v)
+    {
+        out.insert(out.end(), reinterpret_cast<const char *>(&v), reinterpret_cast<const char *>(&v) + 8);
+    }
+
+    inline uint32_t get_u32(const char *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint64_t get_u64(const char *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    // Not cryptographic: catches torn writes and flipped bits, eight bytes
+    // per step so that verifying a multi-GB snapshot is not the bottleneck.
+    inline uint64_t checksum(const char *data, size_t len)
+    {
+        uint64_t h = 0xcbf29ce484222325ull ^ len;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8)
+        {
+            h = (h ^ get_u64(data + i)) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+        }
+        for (; i < len; i++)
+            h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ull;
+        return h;
+    }
+
+    // fsync on the directory, so that a created, renamed or removed file
+    // survives a crash along with its contents
+    inline void sync_directory(const std::string &dir)
+    {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            throw std::runtime_error("open(" + dir + ") failed: " + strerror(errno));
+        int rc = ::fsync(fd);
+        ::close(fd);
+        if (rc != 0)
+            throw std::runtime_error("fsync(" + dir + ") failed: " + strerror(errno));
+    }
+}
+
+// ================== Write-ahead log =====================
+// An append-only log of Set and Delete records, one file per segment.
+//
+// append() only encodes the record into an in-memory batch and hands out a
+// log sequence number; commit(lsn) returns once that record is on disk.
+// With SyncMode::Group the first committer to find no write in progress
+// becomes the leader: it takes the whole batch, writes it with one fwrite
+// and one fdatasync, and wakes everyone it covered. Records appended while
+// it was syncing form the next batch, so under load one fsync is shared by
+// every writer that arrived during the previous one. SyncMode::PerWrite
+// writes and syncs each record inside append(), for comparison.
+//
+// Record: checksum u64 | op u8 | key length u32 | value length u32 | key |
+// value, where the checksum covers everything after it. Sets with an expiry
+// carry it in front of the value. Replay stops at the
+// first record that is short or fails its checksum, i.e. the torn tail of a
+// crash, and cuts the file there.
+enum class WalOp : uint8_t
+{
+    Set = 1,
+    Delete = 2,
+    // on disk only: a Set whose value starts with its expiry time, u64 ms
+    // since the Unix epoch; append() and replay() take and report it as Set
+    SetExpiring = 3,
+};
+
+enum class SyncMode
+{
+    Group,
+    PerWrite,
+};
+
+class WriteAheadLog
+{
+public:
+    static constexpr size_t kRecordHeader = 17;
+
+    // Appends to `path`, creating it if needed.
+    WriteAheadLog(std::string path, SyncMode mode)
+        : m_path(std::move(path)), m_mode(mode), m_file(m_path.c_str(), "ab")
+    {
+        std::fseek(m_file.get(), 0, SEEK_END);
+        m_bytes.store(std::ftell(m_file.get()), std::memory_order_relaxed);
+    }
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        try
+        {
+            commit_locked(lock, m_appended);
+        }
+        catch (const std::runtime_error &)
+        {
+            // nobody left to tell; what was committed is on disk already
+        }
+    }
+
+    // Callers that need the log order to match the order in which they
+    // applied the changes must call this under their own lock.
+    // `expiresAt` is ms since the Unix epoch, 0 for a Set that never expires.
+    uint64_t append(WalOp op, std::string_view key, std::string_view value, uint64_t expiresAt = 0)
+    {
+        bool expiring = op == WalOp::Set && expiresAt != 0;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        size_t start = m_pending.size();
+        kvdisk::put_u64(m_pending, 0);
+        m_pending.push_back(static_cast<char>(expiring ? WalOp::SetExpiring : op));
+        kvdisk::put_u32(m_pending, static_cast<uint32_t>(key.size()));
+        kvdisk::put_u32(m_pending, static_cast<uint32_t>(value.size() + (expiring ? 8 : 0)));
+        m_pending.insert(m_pending.end(), key.begin(), key.end());
+        if (expiring)
+            kvdisk::put_u64(m_pending, expiresAt);
+        m_pending.insert(m_pending.end(), value.begin(), value.end());
+        uint64_t sum = kvdisk::checksum(m_pending.data() + start + 8, m_pending.size() - start - 8);
+        std::memcpy(m_pending.data() + start, &sum, 8);
+        m_bytes.fetch_add(m_pending.size() - start, std::memory_order_relaxed);
+
+        uint64_t lsn = ++m_appended;
+        if (m_mode == SyncMode::PerWrite)
+        {
+            write_and_sync(m_pending);
+            m_pending.clear();
+            m_durable = lsn;
+        }
+        return lsn;
+    }
+
+    // Waits until the record `lsn` and everything before it is on disk.
+    // Throws std::runtime_error if writing the log failed.
+    void commit(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        commit_locked(lock, lsn);
+    }
+
+    // Makes everything appended so far durable.
+    void sync()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        commit_locked(lock, m_appended);
+    }
+
+    // Bytes in this segment, including records not yet on disk.
+    size_t bytes() const
+    {
+        return m_bytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t syncs() const
+    {
+        return m_syncs.load(std::memory_order_relaxed);
+    }
+
+    // Makes everything appended so far durable in the current segment and
+    // sends later records to a new one at `path`. Records appended while
+    // this waits for the last write may land in either.
+    void rotate(std::string path)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        commit_locked(lock, m_appended);
+        // a newer batch's leader may still be writing the old file
+        m_flushed.wait(lock, [this]
+                       { return !m_flushing; });
+        m_file = FileRAII(path.c_str(), "ab");
+        m_path = std::move(path);
+        m_bytes.store(m_pending.size(), std::memory_order_relaxed);
+    }
+
+    // Calls apply(op, key, value, expiresAt) for every intact record of the
+    // log at `path`, in order, and truncates a torn tail. Returns the number of
+    // records applied; a missing file has none.
+    template <typename Apply>
+    static size_t replay(const std::string &path, Apply &&apply)
+    {
+        std::vector<char> data;
+        try
+        {
+            FileRAII file(path.c_str(), "rb");
+            char chunk[1 << 16];
+            size_t n;
+            while ((n = std::fread(chunk, 1, sizeof(chunk), file.get())) > 0)
+                data.insert(data.end(), chunk, chunk + n);
+        }
+        catch (const std::runtime_error &)
+        {
+            return 0;
+        }
+
+        size_t pos = 0, records = 0;
+        while (pos + kRecordHeader <= data.size())
+        {
+            const char *p = data.data() + pos;
+            size_t keyLen = kvdisk::get_u32(p + 9);
+            size_t valueLen = kvdisk::get_u32(p + 13);
+            size_t len = kRecordHeader + keyLen + valueLen;
+            if (pos + len > data.size() || kvdisk::checksum(p + 8, len - 8) != kvdisk::get_u64(p))
+                break;
+            auto op = static_cast<WalOp>(p[8]);
+            std::string_view key(p + kRecordHeader, keyLen), value(p + kRecordHeader + keyLen, valueLen);
+            uint64_t expiresAt = 0;
+            if (op == WalOp::SetExpiring)
+            {
+                if (valueLen < 8)
+                    break;
+                expiresAt = kvdisk::get_u64(value.data());
+                value.remove_prefix(8);
+                op = WalOp::Set;
+            }
+            apply(op, key, value, expiresAt);
+            pos += len;
+            records++;
+        }
+        if (pos < data.size() && ::truncate(path.c_str(), static_cast<off_t>(pos)) != 0)
+            throw std::runtime_error("truncate(" + path + ") failed: " + strerror(errno));
+        return records;
+    }
+
+private:
+    void commit_locked(std::unique_lock<std::mutex> &lock, uint64_t lsn)
+    {
+        while (m_durable < lsn)
+        {
+            if (m_failed)
+                throw std::runtime_error("write-ahead log " + m_path + " failed");
+            if (m_flushing)
+                m_flushed.wait(lock);
+            else
+                flush(lock);
+        }
+    }
+
+    // Called with the lock held and no flush in progress. Writes the current
+    // batch as the leader, with the lock released during the I/O.
+    void flush(std::unique_lock<std::mutex> &lock)
+    {
+        m_flushing = true;
+        std::vector<char> batch;
+        batch.swap(m_pending);
+        m_pending.swap(m_spare); // keep the capacity of an earlier batch
+        uint64_t upto = m_appended;
+        lock.unlock();
+
+        bool ok = true;
+        try
+        {
+            write_and_sync(batch);
+        }
+        catch (const std::runtime_error &)
+        {
+            ok = false;
+        }
+
+        lock.lock();
+        m_flushing = false;
+        if (ok)
+            m_durable = upto;
+        else
+            m_failed = true;
+        batch.clear();
+        m_spare.swap(batch);
+        m_flushed.notify_all();
+        if (!ok)
+            throw std::runtime_error("write-ahead log " + m_path + " failed");
+    }
+
+    void write_and_sync(const std::vector<char> &batch)
+    {
+        FILE *f = m_file.get();
+        if (std::fwrite(batch.data(), 1, batch.size(), f) != batch.size() || std::fflush(f) != 0 ||
+            ::fdatasync(fileno(f)) != 0)
+            throw std::runtime_error("writing " + m_path + " failed: " + strerror(errno));
+        m_syncs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string m_path;
+    const SyncMode m_mode;
+    FileRAII m_file;
+
+    std::mutex m_mutex;
+    std::condition_variable m_flushed;
+    std::vector<char> m_pending;
+    std::vector<char> m_spare;
+    uint64_t m_appended = 0; // last LSN handed out
+    uint64_t m_durable = 0;  // last LSN on disk
+    bool m_flushing = false;
+    bool m_failed = false;
+
+    std::atomic<size_t> m_bytes{0};
+    std::atomic<uint64_t> m_syncs{0};
+};
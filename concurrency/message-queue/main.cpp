@@ -1,41 +1,93 @@
 #include <iostream>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
 #include <chrono>
-#include <optional>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "message_queue.h"
+#include "mpsc_queue.h"
 
 using namespace std;
 
-template <typename T>
-class MessageQueue
+// ================== Allocation counter =====================
+// Counts every global operator new so the benchmark can show which queue
+// stays off the heap once it is warm.
+static atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size)
 {
-public:
-    void push(T item)
-    {
-        lock_guard<mutex> guard(m_qmutex);
-        m_queue.push(item);
-        m_qvar.notify_one();
-    }
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
 
-    T pop()
-    {
-        auto lock = unique_lock<mutex>(m_qmutex);
-        m_qvar.wait(lock, [this]
-                    { return !this->m_queue.empty(); });
-        auto val = m_queue.front();
-        m_queue.pop();
-        return val;
-    }
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
 
-private:
-    queue<T> m_queue;
-    mutex m_qmutex;
-    condition_variable m_qvar;
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// ================== Benchmark =====================
+// `producers` threads push `perProducer` items each and one consumer takes
+// them either one pop at a time or a whole backlog per drain_into(). The
+// producers close the queue when they are done, which is how the consumer
+// knows to stop. Works with any queue offering MessageQueue's interface.
+struct RunResult
+{
+    double itemsPerSecond;
+    size_t allocations;
 };
 
-int main()
+template <bool Batched, typename Queue>
+RunResult run_queue(Queue &mq, int producers, int perProducer)
+{
+    long sum = 0;
+    vector<long> batch;
+    batch.reserve(1 << 16);
+
+    auto allocationsBefore = g_allocations.load();
+    auto start = chrono::high_resolution_clock::now();
+    thread consumer([&mq, &sum, &batch]()
+                    {
+        if constexpr (Batched) {
+            while (mq.drain_into(batch) > 0) {
+                for (long item : batch)
+                    sum += item;
+                batch.clear();
+            }
+        } else {
+            long item;
+            while (mq.pop_for(item, chrono::seconds(1)))
+                sum += item;
+        } });
+
+    vector<thread> threads;
+    threads.reserve(producers);
+    for (int p = 0; p < producers; p++)
+        threads.emplace_back([&mq, perProducer]()
+                             {
+            for (int i = 0; i < perProducer; ++i)
+                mq.push(1); });
+    for (auto &t : threads)
+        t.join();
+    mq.close();
+    consumer.join();
+    auto end = chrono::high_resolution_clock::now();
+
+    if (sum != static_cast<long>(producers) * perProducer)
+        cerr << "lost items: " << sum << "\n";
+    return {sum / chrono::duration<double>(end - start).count(), g_allocations.load() - allocationsBefore};
+}
+
+int main(int argc, char **argv)
 {
     MessageQueue<int> mq;
 
@@ -59,5 +111,62 @@ int main()
     producer.join();
     consumer.join();
 
+    // backpressure: a bounded queue in front of a slow consumer. push()
+    // waits for room, try_push() turns the overflow away instead.
+    {
+        MessageQueue<int> bounded(4);
+        int rejected = 0;
+        for (int i = 0; i < 10; i++)
+        {
+            if (!bounded.try_push(i))
+                rejected++;
+        }
+        cout << "\nBounded queue of 4: " << bounded.size() << " queued, " << rejected << " rejected\n";
+
+        thread slowConsumer([&bounded]()
+                            {
+            int item;
+            while (bounded.pop_for(item, chrono::milliseconds(200)))
+                this_thread::sleep_for(chrono::milliseconds(10)); });
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 20; i++)
+            bounded.push(i);
+        cout << "20 blocking pushes took "
+             << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+             << "ms behind a 10ms/item consumer\n";
+        bounded.close();
+        slowConsumer.join();
+        cout << "after close: push accepted = " << boolalpha << bounded.push(1) << "\n";
+    }
+
+    int perProducer = argc > 1 ? stoi(argv[1]) : 1'000'000;
+    cout << "\nproducers  pop() items/s  drain_into() items/s  (bounded MessageQueue, capacity 1024)\n";
+    for (int producers = 1; producers <= 8; producers *= 2)
+    {
+        MessageQueue<long> single(1024), batched(1024);
+        auto s = run_queue<false>(single, producers, perProducer / producers);
+        auto b = run_queue<true>(batched, producers, perProducer / producers);
+        cout << producers << "\t   " << s.itemsPerSecond << "\t " << b.itemsPerSecond << "\n";
+    }
+
+    // many producers, one consumer: the unbounded MessageQueue against the
+    // lock-free MpscQueue. Each MpscQueue run follows a warm-up run so the
+    // node pool already holds enough nodes and the allocations show steady
+    // state.
+    cout << "\nproducers  MessageQueue items/s  allocs   MpscQueue items/s  allocs\n";
+    for (int producers = 1; producers <= 16; producers *= 2)
+    {
+        MessageQueue<long> locked;
+        auto l = run_queue<false>(locked, producers, perProducer / producers);
+        {
+            MpscQueue<long> warmup;
+            run_queue<false>(warmup, producers, perProducer / producers);
+        }
+        MpscQueue<long> lockFree;
+        auto f = run_queue<false>(lockFree, producers, perProducer / producers);
+        cout << producers << "\t   " << l.itemsPerSecond << "\t\t" << l.allocations << "\t  "
+             << f.itemsPerSecond << "\t     " << f.allocations << "\n";
+    }
+
     return 0;
-}
\ No newline at end of file
+}
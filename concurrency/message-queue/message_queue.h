@@ -0,0 +1,297 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// A blocking multi-producer/multi-consumer queue.
+//
+// Bounded when constructed with a capacity: push() then waits for room and
+// try_push() rejects instead. close() stops accepting pushes and wakes every
+// waiter; consumers still get what was queued before the close, after which
+// pop() throws and the other pops report failure.
+//
+// Condition variables are only signalled when somebody is actually waiting,
+// and always after the lock is released, so the common uncontended push or
+// pop is one lock round trip without a futex wake.
+template <typename T>
+class MessageQueue
+{
+public:
+    // A consumer that wants the next item handed to it instead of blocking a
+    // thread in pop(), e.g. a suspended coroutine. deliver() or closed() is
+    // called outside the queue lock, on the pushing or closing thread.
+    struct PopWaiter
+    {
+        virtual void deliver(T item) = 0;
+        virtual void closed() = 0;
+        PopWaiter *next = nullptr;
+
+    protected:
+        ~PopWaiter() = default;
+    };
+
+    // capacity 0 means unbounded
+    explicit MessageQueue(size_t capacity = 0) : m_capacity(capacity) {}
+
+    MessageQueue(const MessageQueue &) = delete;
+    MessageQueue &operator=(const MessageQueue &) = delete;
+
+    // Waits while the queue is full. Returns false, dropping the item, if
+    // the queue is closed.
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (full() && !m_closed)
+        {
+            m_waitingProducers++;
+            m_notFull.wait(lock, [this]
+                           { return !full() || m_closed; });
+            m_waitingProducers--;
+        }
+        if (m_closed)
+            return false;
+        enqueue(std::move(item), lock);
+        return true;
+    }
+
+    // Never waits: returns false if the queue is full or closed, in which
+    // case `item` is left untouched.
+    template <typename U>
+    bool try_push(U &&item)
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (full() || m_closed)
+            return false;
+        enqueue(T(std::forward<U>(item)), lock);
+        return true;
+    }
+
+    // Never waits: if the queue is full the oldest item is dropped to make
+    // room, and `dropped` is incremented. Returns false if the queue is
+    // closed. The dropped item is destroyed after the lock is released.
+    bool push_evicting(T item, size_t &dropped)
+    {
+        std::optional<T> evicted;
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (m_closed)
+            return false;
+        if (full())
+        {
+            evicted.emplace(std::move(m_queue.front()));
+            m_queue.pop_front();
+            dropped++;
+        }
+        enqueue(std::move(item), lock);
+        return true;
+    }
+
+    // Waits for an item. Throws std::runtime_error once the queue is closed
+    // and empty.
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        wait_not_empty(lock);
+        if (m_queue.empty())
+            throw std::runtime_error("MessageQueue: closed");
+        T val = std::move(m_queue.front());
+        m_queue.pop_front();
+        release_slots(lock);
+        return val;
+    }
+
+    bool try_pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (m_queue.empty())
+            return false;
+        item = std::move(m_queue.front());
+        m_queue.pop_front();
+        release_slots(lock);
+        return true;
+    }
+
+    // Waits up to `timeout` for an item. Returns false on timeout, or once
+    // the queue is closed and empty.
+    template <typename Rep, typename Period>
+    bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (m_queue.empty() && !m_closed)
+        {
+            m_waitingConsumers++;
+            m_notEmpty.wait_for(lock, timeout, [this]
+                                { return !m_queue.empty() || m_closed; });
+            m_waitingConsumers--;
+        }
+        if (m_queue.empty())
+            return false;
+        item = std::move(m_queue.front());
+        m_queue.pop_front();
+        release_slots(lock);
+        return true;
+    }
+
+    // Waits for at least one item, then takes the whole backlog in a single
+    // lock acquisition by swapping the internal deque out, and appends it to
+    // `out` (anything with push_back) after the lock is released. Returns the
+    // number of items taken, 0 once the queue is closed and empty.
+    template <typename Container>
+    size_t drain_into(Container &out)
+    {
+        std::deque<T> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_qmutex);
+            wait_not_empty(lock);
+            batch.swap(m_queue);
+            if (m_waitingProducers > 0)
+            {
+                lock.unlock();
+                m_notFull.notify_all(); // the whole capacity just came free
+            }
+        }
+
+        size_t n = batch.size();
+        if constexpr (std::is_same_v<Container, std::deque<T>>)
+        {
+            if (out.empty())
+            {
+                out.swap(batch);
+                return n;
+            }
+        }
+        for (auto &item : batch)
+            out.push_back(std::move(item));
+        return n;
+    }
+
+    // Pops into `item` if something is queued. Otherwise parks `waiter`, which
+    // will receive the next pushed item, and returns false. Parked waiters are
+    // served in FIFO order and ahead of threads blocked in pop(). If the queue
+    // is closed and empty the waiter's closed() is called right away.
+    bool pop_or_wait(T &item, PopWaiter *waiter)
+    {
+        std::unique_lock<std::mutex> lock(m_qmutex);
+        if (!m_queue.empty())
+        {
+            item = std::move(m_queue.front());
+            m_queue.pop_front();
+            release_slots(lock);
+            return true;
+        }
+        if (m_closed)
+        {
+            lock.unlock();
+            waiter->closed();
+            return false;
+        }
+        waiter->next = nullptr;
+        if (m_waitTail)
+            m_waitTail->next = waiter;
+        else
+            m_waitHead = waiter;
+        m_waitTail = waiter;
+        return false;
+    }
+
+    // Rejects further pushes and wakes every blocked producer, consumer and
+    // parked waiter. Items already queued can still be popped.
+    void close()
+    {
+        PopWaiter *waiters;
+        {
+            std::lock_guard<std::mutex> guard(m_qmutex);
+            if (m_closed)
+                return;
+            m_closed = true;
+            waiters = m_waitHead;
+            m_waitHead = m_waitTail = nullptr;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+        while (waiters)
+        {
+            PopWaiter *next = waiters->next; // closed() may free the waiter
+            waiters->closed();
+            waiters = next;
+        }
+    }
+
+    bool closed() const
+    {
+        std::lock_guard<std::mutex> guard(m_qmutex);
+        return m_closed;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(m_qmutex);
+        return m_queue.size();
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    bool full() const
+    {
+        return m_capacity != 0 && m_queue.size() >= m_capacity;
+    }
+
+    // Called with the lock held and not closed; hands the item to a parked
+    // waiter if there is one, queues it otherwise. Releases the lock.
+    void enqueue(T item, std::unique_lock<std::mutex> &lock)
+    {
+        if (PopWaiter *waiter = m_waitHead)
+        {
+            m_waitHead = waiter->next;
+            if (!m_waitHead)
+                m_waitTail = nullptr;
+            lock.unlock();
+            waiter->deliver(std::move(item));
+            return;
+        }
+        m_queue.push_back(std::move(item));
+        bool wake = m_waitingConsumers > 0;
+        lock.unlock();
+        if (wake)
+            m_notEmpty.notify_one();
+    }
+
+    void wait_not_empty(std::unique_lock<std::mutex> &lock)
+    {
+        if (!m_queue.empty() || m_closed)
+            return;
+        m_waitingConsumers++;
+        m_notEmpty.wait(lock, [this]
+                        { return !m_queue.empty() || m_closed; });
+        m_waitingConsumers--;
+    }
+
+    // Called with the lock held after one item was taken. Releases the lock.
+    void release_slots(std::unique_lock<std::mutex> &lock)
+    {
+        bool wake = m_waitingProducers > 0;
+        lock.unlock();
+        if (wake)
+            m_notFull.notify_one();
+    }
+
+    std::deque<T> m_queue;
+    const size_t m_capacity;
+    bool m_closed = false;
+    size_t m_waitingConsumers = 0;
+    size_t m_waitingProducers = 0;
+    mutable std::mutex m_qmutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    PopWaiter *m_waitHead = nullptr;
+    PopWaiter *m_waitTail = nullptr;
+};
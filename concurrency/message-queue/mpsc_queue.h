@@ -0,0 +1,320 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ================== Recycled nodes =====================
+// Nodes for MpscQueue<T>, shared by every queue of the same T. Each thread
+// keeps a private free list; producers take nodes from theirs and the
+// consumer returns them to its own, and whole batches move between threads
+// through a mutex-protected list, once per kBatchSize nodes. Slabs are only
+// allocated while the pool warms up, so a queue in steady state does not
+// touch the heap.
+template <typename T>
+struct MpscNode
+{
+    std::atomic<MpscNode *> next{nullptr};
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T *value()
+    {
+        return std::launder(reinterpret_cast<T *>(storage));
+    }
+};
+
+template <typename T>
+class MpscNodePool
+{
+public:
+    using Node = MpscNode<T>;
+    static constexpr size_t kBatchSize = 256;
+
+    static MpscNodePool &getInstance()
+    {
+        static MpscNodePool instance;
+        return instance;
+    }
+
+    Node *acquire()
+    {
+        auto &cache = local_cache();
+        if (!cache.head)
+            refill(cache);
+
+        Node *node = cache.head;
+        cache.head = node->next.load(std::memory_order_relaxed);
+        cache.count--;
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+    }
+
+    void release(Node *node)
+    {
+        auto &cache = local_cache();
+        node->next.store(cache.head, std::memory_order_relaxed);
+        cache.head = node;
+        if (++cache.count >= 2 * kBatchSize)
+            spill(cache, kBatchSize);
+    }
+
+private:
+    struct LocalCache
+    {
+        Node *head = nullptr;
+        size_t count = 0;
+
+        ~LocalCache()
+        {
+            if (head)
+                MpscNodePool::getInstance().spill(*this, count);
+        }
+    };
+
+    struct Batch
+    {
+        Node *head;
+        size_t count;
+    };
+
+    MpscNodePool() = default;
+
+    void refill(LocalCache &cache)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_batches.empty())
+        {
+            // only reached while the pool warms up
+            m_slabs.emplace_back(new Node[kBatchSize]);
+            Node *slab = m_slabs.back().get();
+            for (size_t i = 0; i + 1 < kBatchSize; i++)
+                slab[i].next.store(&slab[i + 1], std::memory_order_relaxed);
+            m_batches.push_back({slab, kBatchSize});
+        }
+        auto batch = m_batches.back();
+        m_batches.pop_back();
+        cache.head = batch.head;
+        cache.count = batch.count;
+    }
+
+    void spill(LocalCache &cache, size_t n)
+    {
+        Node *head = cache.head;
+        Node *tail = head;
+        for (size_t i = 1; i < n; i++)
+            tail = tail->next.load(std::memory_order_relaxed);
+        cache.head = tail->next.load(std::memory_order_relaxed);
+        cache.count -= n;
+        tail->next.store(nullptr, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_batches.push_back({head, n});
+    }
+
+    static LocalCache &local_cache()
+    {
+        static thread_local LocalCache cache;
+        return cache;
+    }
+
+    std::mutex m_mutex;
+    std::vector<Batch> m_batches;
+    std::vector<std::unique_ptr<Node[]>> m_slabs;
+};
+
+// ================== Lock-free MPSC queue =====================
+// Dmitry Vyukov's intrusive multi-producer/single-consumer list. A push is
+// one exchange on the head plus a store linking the previous node, so it is
+// wait-free and producers never serialize on a lock. The consumer owns the
+// tail and pops without any atomic read-modify-write.
+//
+// Offers the same calls as MessageQueue (push, try_push, pop, try_pop,
+// pop_for, drain_into, close) so one can be swapped for the other, with two
+// differences: it is unbounded, and only one thread may consume at a time.
+// The consumer parks on a futex only when it finds the queue empty, and a
+// producer only issues a wake when its exchange sees the consumer parked.
+//
+// A producer preempted between its exchange and its link hides everything
+// pushed after it until it runs again; the consumer yields until then.
+template <typename T>
+class MpscQueue
+{
+public:
+    using Node = MpscNode<T>;
+
+    MpscQueue() : m_pool(MpscNodePool<T>::getInstance())
+    {
+        Node *stub = m_pool.acquire();
+        m_head.store(stub, std::memory_order_relaxed);
+        m_tail = stub;
+    }
+
+    ~MpscQueue()
+    {
+        T item;
+        while (try_pop(item))
+        {
+        }
+        m_pool.release(m_tail);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // Wait-free. Returns false, dropping the item, once the queue is closed.
+    bool push(T item)
+    {
+        if (m_closed.load(std::memory_order_relaxed))
+            return false;
+
+        Node *node = m_pool.acquire();
+        new (node->storage) T(std::move(item));
+        // seq_cst: pairs with the consumer's store to m_parked, so either the
+        // consumer sees this node or we see it parked
+        Node *prev = m_head.exchange(node, std::memory_order_seq_cst);
+        prev->next.store(node, std::memory_order_release);
+
+        if (m_parked.load(std::memory_order_seq_cst))
+            wake_consumer();
+        return true;
+    }
+
+    // The queue is never full, so this only fails once closed.
+    template <typename U>
+    bool try_push(U &&item)
+    {
+        return push(T(std::forward<U>(item)));
+    }
+
+    // ---- consumer side, one thread at a time ----
+
+    bool try_pop(T &item)
+    {
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+        {
+            if (m_head.load(std::memory_order_acquire) == tail)
+                return false;
+            // a producer has swapped the head but not linked its node yet
+            while (!(next = tail->next.load(std::memory_order_acquire)))
+                std::this_thread::yield();
+        }
+
+        // `next` becomes the new stub once its value is moved out
+        item = std::move(*next->value());
+        next->value()->~T();
+        m_tail = next;
+        m_pool.release(tail);
+        return true;
+    }
+
+    // Waits for an item. Throws std::runtime_error once the queue is closed
+    // and empty.
+    T pop()
+    {
+        T item;
+        while (!try_pop(item))
+        {
+            if (closed_and_empty())
+                throw std::runtime_error("MpscQueue: closed");
+            park(nullptr);
+        }
+        return item;
+    }
+
+    // Waits up to `timeout` for an item. Returns false on timeout, or once
+    // the queue is closed and empty.
+    template <typename Rep, typename Period>
+    bool pop_for(T &item, std::chrono::duration<Rep, Period> timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!try_pop(item))
+        {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (closed_and_empty() || left <= left.zero())
+                return false;
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            timespec ts{static_cast<time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000)};
+            park(&ts);
+        }
+        return true;
+    }
+
+    // Waits for at least one item, then pops everything currently linked
+    // into `out`. Returns the number of items taken, 0 once the queue is
+    // closed and empty.
+    template <typename Container>
+    size_t drain_into(Container &out)
+    {
+        T item;
+        size_t n = 0;
+        while (true)
+        {
+            while (try_pop(item))
+            {
+                out.push_back(std::move(item));
+                n++;
+            }
+            if (n > 0 || closed_and_empty())
+                return n;
+            park(nullptr);
+        }
+    }
+
+    // Rejects further pushes and wakes the consumer. A push racing with
+    // close() may still get in; the consumer drains it like any other.
+    void close()
+    {
+        m_closed.store(true, std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_seq_cst))
+            wake_consumer();
+    }
+
+    bool closed() const
+    {
+        return m_closed.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool closed_and_empty() const
+    {
+        return m_closed.load(std::memory_order_acquire) && m_head.load(std::memory_order_acquire) == m_tail;
+    }
+
+    // Sleeps until a producer or close() wakes us, or `timeout` passes.
+    // Returns straight away if something arrived after the last check.
+    void park(const timespec *timeout)
+    {
+        m_parked.store(1, std::memory_order_seq_cst);
+        if (m_head.load(std::memory_order_seq_cst) == m_tail && !m_closed.load(std::memory_order_seq_cst))
+            syscall(SYS_futex, &m_parked, FUTEX_WAIT_PRIVATE, 1, timeout, nullptr, 0);
+        m_parked.store(0, std::memory_order_relaxed);
+    }
+
+    void wake_consumer()
+    {
+        // several producers may see the flag; only the first one wakes
+        if (m_parked.exchange(0, std::memory_order_relaxed) == 1)
+            syscall(SYS_futex, &m_parked, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    MpscNodePool<T> &m_pool;
+
+    alignas(64) std::atomic<Node *> m_head; // last pushed node, shared by producers
+    alignas(64) Node *m_tail;               // stub before the oldest item, consumer only
+    // read by every push, written only when the consumer parks or on close
+    alignas(64) std::atomic<uint32_t> m_parked{0};
+    std::atomic<bool> m_closed{false};
+};
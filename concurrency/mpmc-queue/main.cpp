@@ -0,0 +1,192 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <cstdlib>
+
+#include "../message-queue/message_queue.h"
+
+using namespace std;
+
+// ================== Bounded MPMC queue =====================
+// Dmitry Vyukov's bounded queue. Every slot carries a sequence number that
+// says whose turn it is: a slot at position pos is free for the producer that
+// claims pos when seq == pos, and holds data for the consumer that claims pos
+// when seq == pos + 1. Producers and consumers claim positions with a CAS on
+// their own counter and then only touch their slot, so a push and a pop never
+// contend with each other and each one costs a single CAS when uncontended.
+//
+// Same interface as RingBuffer: push and pop never block and return false
+// when the queue is full or empty.
+template <typename T, size_t SIZE>
+class MPMCQueue
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be power of two");
+    static_assert(SIZE >= 2, "SIZE must be at least 2");
+
+private:
+    static constexpr size_t MASK = SIZE - 1;
+
+    struct Slot
+    {
+        atomic<size_t> seq;
+        T data;
+    };
+
+    Slot buffer[SIZE];
+
+    alignas(64) atomic<size_t> head{0}; // next position to push
+    alignas(64) atomic<size_t> tail{0}; // next position to pop
+
+public:
+    MPMCQueue()
+    {
+        for (size_t i = 0; i < SIZE; i++)
+            buffer[i].seq.store(i, memory_order_relaxed);
+    }
+
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    bool push(const T &item)
+    {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true)
+        {
+            Slot &slot = buffer[pos & MASK];
+            size_t seq = slot.seq.load(memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    slot.data = item;
+                    slot.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // the slot still holds the item from a lap ago
+            else
+                pos = head.load(memory_order_relaxed);
+        }
+    }
+
+    bool pop(T &item)
+    {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true)
+        {
+            Slot &slot = buffer[pos & MASK];
+            size_t seq = slot.seq.load(memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                {
+                    item = std::move(slot.data);
+                    slot.seq.store(pos + SIZE, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // nothing pushed into this slot yet
+            else
+                pos = tail.load(memory_order_relaxed);
+        }
+    }
+
+    // Only a hint while other threads are pushing or popping.
+    size_t size_approx() const
+    {
+        size_t h = head.load(memory_order_relaxed);
+        size_t t = tail.load(memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+};
+
+// ================== Benchmark =====================
+// `threads` producers and as many consumers move `total` messages. Each
+// message is (producer << 32 | sequence) and every consumer checks that it
+// sees each producer's messages in increasing order. A side that finds the
+// queue full or empty yields, so the numbers stay meaningful when there are
+// more threads than cores.
+constexpr size_t kQueueSize = 1 << 16;
+
+void check_order(vector<int64_t> &last, uint64_t msg)
+{
+    auto producer = msg >> 32;
+    auto seq = static_cast<int64_t>(msg & 0xffffffff);
+    if (seq <= last[producer])
+    {
+        cerr << "out of order message from producer " << producer << "\n";
+        exit(1);
+    }
+    last[producer] = seq;
+}
+
+template <typename Queue>
+double ops_per_second(int threads, size_t total)
+{
+    auto queue = make_unique<Queue>();
+    size_t perThread = total / threads;
+    vector<thread> workers;
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int p = 0; p < threads; p++)
+    {
+        workers.emplace_back([&queue, p, perThread]
+                             {
+                                 for (uint64_t i = 0; i < perThread; i++)
+                                 {
+                                     uint64_t msg = static_cast<uint64_t>(p) << 32 | i;
+                                     if constexpr (is_same_v<Queue, MessageQueue<uint64_t>>)
+                                         queue->push(msg);
+                                     else
+                                         while (!queue->push(msg))
+                                             this_thread::yield();
+                                 } });
+    }
+    for (int c = 0; c < threads; c++)
+    {
+        workers.emplace_back([&queue, threads, perThread]
+                             {
+                                 vector<int64_t> last(threads, -1);
+                                 for (size_t i = 0; i < perThread; i++)
+                                 {
+                                     uint64_t msg;
+                                     if constexpr (is_same_v<Queue, MessageQueue<uint64_t>>)
+                                         msg = queue->pop();
+                                     else
+                                         while (!queue->pop(msg))
+                                             this_thread::yield();
+                                     check_order(last, msg);
+                                 } });
+    }
+    for (auto &w : workers)
+        w.join();
+    auto end = chrono::high_resolution_clock::now();
+
+    return perThread * threads / chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t total = argc > 1 ? stoul(argv[1]) : 4'000'000;
+
+    cout << "Moving " << total << " messages through a " << kQueueSize << " slot queue\n";
+    cout << "producers/consumers  MessageQueue ops/s  MPMCQueue ops/s\n";
+    for (int threads = 1; threads <= 16; threads *= 2)
+    {
+        double locked = ops_per_second<MessageQueue<uint64_t>>(threads, total);
+        double lockFree = ops_per_second<MPMCQueue<uint64_t, kQueueSize>>(threads, total);
+        cout << threads << "/" << threads << "\t\t     " << locked << "\t\t" << lockFree << "\n";
+    }
+
+    return 0;
+}
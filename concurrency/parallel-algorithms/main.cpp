@@ -0,0 +1,392 @@
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <exception>
+
+#include "../thread-pool/thread_pool.h"
+#include "../../containers/vector/my_vector.h"
+
+using namespace std;
+
+// ================== Chunking =====================
+// Inputs of at most `grain` elements run serially on the calling thread.
+// Larger ones are cut into at most kChunksPerWorker chunks per worker, each at
+// least `grain` elements long, so there is enough slack for stealing to even
+// out the load without drowning short loops in scheduling overhead.
+constexpr size_t kDefaultGrain = 16 * 1024;
+constexpr size_t kChunksPerWorker = 4;
+
+inline size_t chunk_size(const ThreadPool &pool, size_t n, size_t grain)
+{
+    size_t workers = max<size_t>(pool.num_workers(), 1);
+    size_t chunk = (n + workers * kChunksPerWorker - 1) / (workers * kChunksPerWorker);
+    return max(chunk, max<size_t>(grain, 1));
+}
+
+// Waits for every future not yet taken, then rethrows the first exception: `error`, the
+// caller's own, if set, otherwise the first one a task threw. Tasks capture
+// the caller's locals by reference, so none may still be running when it
+// unwinds.
+template <typename Future>
+void wait_all(vector<Future> &pending, exception_ptr error = nullptr)
+{
+    for (auto &f : pending)
+    {
+        if (!f.valid())
+            continue;
+        try
+        {
+            f.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = current_exception();
+        }
+    }
+    if (error)
+        rethrow_exception(error);
+}
+
+// Calls body(lo, hi) for consecutive sub-ranges of [begin, end). The last
+// chunk runs on the calling thread, the rest on the pool. If any call
+// throws, the first exception is rethrown once every chunk has finished.
+template <typename Body>
+void parallel_chunks(ThreadPool &pool, size_t begin, size_t end, size_t grain, Body &&body)
+{
+    size_t n = end > begin ? end - begin : 0;
+    if (n <= grain || pool.num_workers() < 2)
+    {
+        body(begin, end);
+        return;
+    }
+
+    size_t chunk = chunk_size(pool, n, grain);
+    vector<TaskFuture<void>> pending;
+    pending.reserve(n / chunk + 1);
+
+    exception_ptr error;
+    try
+    {
+        size_t lo = begin;
+        for (; lo + chunk < end; lo += chunk)
+            pending.push_back(pool.submit([&body, lo, chunk]
+                                          { body(lo, lo + chunk); }));
+        body(lo, end);
+    }
+    catch (...)
+    {
+        error = current_exception();
+    }
+    wait_all(pending, error);
+}
+
+// ================== parallel_for =====================
+template <typename F>
+void parallel_for(ThreadPool &pool, size_t begin, size_t end, F &&f, size_t grain = kDefaultGrain)
+{
+    parallel_chunks(pool, begin, end, grain, [&f](size_t lo, size_t hi)
+                    {
+                        for (size_t i = lo; i < hi; i++)
+                            f(i); });
+}
+
+template <typename T, typename F>
+void parallel_for(ThreadPool &pool, MyVector<T> &v, F &&f, size_t grain = kDefaultGrain)
+{
+    T *data = v.begin();
+    parallel_chunks(pool, 0, v.size(), grain, [data, &f](size_t lo, size_t hi)
+                    {
+                        for (size_t i = lo; i < hi; i++)
+                            f(data[i]); });
+}
+
+// ================== parallel_reduce =====================
+// Runs chunk(lo, hi) -> R for consecutive sub-ranges of [0, n) and folds the
+// results into `init` with combine(acc, partial), left to right. Every chunk
+// has finished before an exception from any of them is rethrown.
+template <typename R, typename Chunk, typename Combine>
+R reduce_chunks(ThreadPool &pool, size_t n, R init, Chunk &chunkFn, Combine &combine, size_t grain)
+{
+    size_t chunk = chunk_size(pool, n, grain);
+    vector<TaskFuture<R>> partials;
+    partials.reserve(n / chunk + 1);
+    exception_ptr error;
+    try
+    {
+        for (size_t lo = 0; lo < n; lo += chunk)
+        {
+            size_t hi = min(lo + chunk, n);
+            partials.push_back(pool.submit([&chunkFn, lo, hi]
+                                           { return chunkFn(lo, hi); }));
+        }
+        for (auto &p : partials)
+            init = combine(init, p.get());
+    }
+    catch (...)
+    {
+        error = current_exception();
+    }
+    if (error)
+        wait_all(partials, error);
+    return init;
+}
+
+// Like std::reduce: `op` combines elements and partial results alike, so it
+// takes (R, T) as well as (R, R), must be associative, and `init` is used
+// exactly once. Partial results are combined left to right, so `op` does not
+// have to be commutative. With anything else the result depends on the grain
+// and the number of workers; use the overload with `combine` instead.
+template <typename T, typename R, typename Op>
+R parallel_reduce(ThreadPool &pool, const MyVector<T> &v, R init, Op op, size_t grain = kDefaultGrain)
+{
+    const T *data = v.begin();
+    size_t n = v.size();
+    if (n <= grain || pool.num_workers() < 2)
+    {
+        for (size_t i = 0; i < n; i++)
+            init = op(init, data[i]);
+        return init;
+    }
+
+    auto chunk = [data, &op](size_t lo, size_t hi)
+    {
+        R acc = data[lo];
+        for (size_t i = lo + 1; i < hi; i++)
+            acc = op(acc, data[i]);
+        return acc;
+    };
+    return reduce_chunks(pool, n, init, chunk, op, grain);
+}
+
+// Folds op(acc, element) over every element, where the element need not be
+// an R, e.g. summing string lengths. Each chunk folds from `identity`, and
+// the partial results are folded into `init` with combine(acc, partial).
+// Matches the serial fold of `op` from `init`, whatever the grain and
+// worker count, when folding a run from `identity` and combining the result
+// into r gives the same as folding the run from r, as it does for
+// op = acc + s.size() and combine = +.
+template <typename T, typename R, typename Op, typename Combine>
+R parallel_reduce(ThreadPool &pool, const MyVector<T> &v, R init, R identity, Op op, Combine combine,
+                  size_t grain = kDefaultGrain)
+{
+    const T *data = v.begin();
+    size_t n = v.size();
+    if (n <= grain || pool.num_workers() < 2)
+    {
+        for (size_t i = 0; i < n; i++)
+            init = op(init, data[i]);
+        return init;
+    }
+
+    auto chunk = [data, &identity, &op](size_t lo, size_t hi)
+    {
+        R acc = identity;
+        for (size_t i = lo; i < hi; i++)
+            acc = op(acc, data[i]);
+        return acc;
+    };
+    return reduce_chunks(pool, n, init, chunk, combine, grain);
+}
+
+// ================== parallel_transform =====================
+// Resizes `out` to match `in` and writes out[i] = f(in[i]).
+template <typename T, typename U, typename F>
+void parallel_transform(ThreadPool &pool, const MyVector<T> &in, MyVector<U> &out, F &&f, size_t grain = kDefaultGrain)
+{
+    out.resize(in.size());
+    const T *src = in.begin();
+    U *dst = out.begin();
+    parallel_chunks(pool, 0, in.size(), grain, [src, dst, &f](size_t lo, size_t hi)
+                    {
+                        for (size_t i = lo; i < hi; i++)
+                            dst[i] = f(src[i]); });
+}
+
+// ================== parallel_sort =====================
+// Merge sort with both halves sorted in parallel and the merges themselves
+// split in parallel: the middle element of the longer run is binary searched
+// in the shorter one, which yields two independent merges. Sorting ping-pongs
+// between the vector and one scratch buffer so every level moves each
+// element exactly once. Not stable.
+template <typename T, typename Compare>
+void parallel_merge(ThreadPool &pool, T *a, size_t na, T *b, size_t nb, T *out, Compare &comp, size_t grain)
+{
+    if (na < nb)
+    {
+        swap(a, b);
+        swap(na, nb);
+    }
+
+    size_t ma = na / 2;
+    size_t mb = na + nb > grain ? lower_bound(b, b + nb, a[ma], comp) - b : 0;
+    // small enough, or a split that leaves the left half empty and the
+    // right half the whole merge again
+    if (na + nb <= grain || ma + mb == 0)
+    {
+        merge(make_move_iterator(a), make_move_iterator(a + na),
+              make_move_iterator(b), make_move_iterator(b + nb), out, comp);
+        return;
+    }
+
+    auto left = pool.submit([&pool, a, ma, b, mb, out, &comp, grain]
+                            { parallel_merge(pool, a, ma, b, mb, out, comp, grain); });
+    try
+    {
+        parallel_merge(pool, a + ma, na - ma, b + mb, nb - mb, out + ma + mb, comp, grain);
+    }
+    catch (...)
+    {
+        left.wait(); // it uses `comp` and the buffers we are unwinding past
+        throw;
+    }
+    left.get();
+}
+
+// Sorts data[lo, hi). The result is left in buffer[lo, hi) if to_buffer is
+// set, in data[lo, hi) otherwise.
+template <typename T, typename Compare>
+void parallel_merge_sort(ThreadPool &pool, T *data, T *buffer, size_t lo, size_t hi, bool to_buffer, Compare &comp, size_t grain)
+{
+    if (hi - lo <= grain)
+    {
+        sort(data + lo, data + hi, comp);
+        if (to_buffer)
+            move(data + lo, data + hi, buffer + lo);
+        return;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    auto left = pool.submit([&pool, data, buffer, lo, mid, to_buffer, &comp, grain]
+                            { parallel_merge_sort(pool, data, buffer, lo, mid, !to_buffer, comp, grain); });
+    try
+    {
+        parallel_merge_sort(pool, data, buffer, mid, hi, !to_buffer, comp, grain);
+    }
+    catch (...)
+    {
+        left.wait();
+        throw;
+    }
+    left.get();
+
+    // the halves sit in whichever array we are not merging into
+    T *src = to_buffer ? data : buffer;
+    T *dst = to_buffer ? buffer : data;
+    parallel_merge(pool, src + lo, mid - lo, src + mid, hi - mid, dst + lo, comp, grain);
+}
+
+template <typename T, typename Compare = less<T>>
+void parallel_sort(ThreadPool &pool, MyVector<T> &v, Compare comp = Compare(), size_t grain = kDefaultGrain)
+{
+    // below 2 a range never gets shorter when split in half
+    grain = max<size_t>(grain, 2);
+    size_t n = v.size();
+    if (n <= grain || pool.num_workers() < 2)
+    {
+        sort(v.begin(), v.end(), comp);
+        return;
+    }
+
+    MyVector<T> buffer;
+    buffer.resize(n);
+    parallel_merge_sort(pool, v.begin(), buffer.begin(), 0, n, false, comp, grain);
+}
+
+// ================== Benchmark =====================
+template <typename F>
+double time_it(F &&f)
+{
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double>(end - start).count();
+}
+
+MyVector<uint32_t> random_input(size_t n)
+{
+    MyVector<uint32_t> v;
+    v.resize(n);
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < n; i++)
+    {
+        // xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        v[i] = x;
+    }
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? stoul(argv[1]) : 10'000'000;
+    unsigned maxThreads = argc > 2 ? stoul(argv[2]) : max(thread::hardware_concurrency(), 8u);
+
+    auto input = random_input(n);
+
+    // serial baselines, run on the same data the parallel versions see
+    MyVector<double> out;
+    out.resize(n);
+    for (size_t i = 0; i < n; i++)
+        out[i] = 0.0; // fault the pages in up front
+
+    auto data = input;
+    auto sorted = input;
+    uint64_t serialSum = 0;
+
+    double serialFor = time_it([&]
+                               {
+                                   for (auto &x : data)
+                                       x = x / 2 + 1; });
+    double serialReduce = time_it([&]
+                                  {
+                                      for (auto x : input)
+                                          serialSum += x; });
+    double serialTransform = time_it([&]
+                                     {
+                                         for (size_t i = 0; i < n; i++)
+                                             out[i] = input[i] * 0.25 + 1.0; });
+    double serialSort = time_it([&]
+                                { sort(sorted.begin(), sorted.end()); });
+
+    cout << "n = " << n << "\n";
+    cout << "threads    for      reduce   transform  sort     (speedup over serial)\n";
+    cout << "serial   " << serialFor << "s " << serialReduce << "s " << serialTransform << "s " << serialSort << "s\n";
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        ThreadPool pool(threads);
+
+        data = input;
+        uint64_t sum = 0;
+        double tFor = time_it([&]
+                              { parallel_for(pool, data, [](uint32_t &x)
+                                             { x = x / 2 + 1; }); });
+        data = input;
+        double tReduce = time_it([&]
+                                 { sum = parallel_reduce(pool, data, uint64_t{0}, [](uint64_t acc, uint64_t x)
+                                                         { return acc + x; }); });
+        double tTransform = time_it([&]
+                                    { parallel_transform(pool, data, out, [](uint32_t x)
+                                                         { return x * 0.25 + 1.0; }); });
+        double tSort = time_it([&]
+                               { parallel_sort(pool, data); });
+
+        if (sum != serialSum || !equal(data.begin(), data.end(), sorted.begin()))
+        {
+            cerr << "parallel result mismatch at " << threads << " threads\n";
+            return 1;
+        }
+
+        cout << threads << "\t " << serialFor / tFor << "x\t  " << serialReduce / tReduce << "x\t  "
+             << serialTransform / tTransform << "x\t     " << serialSort / tSort << "x\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+
+#include "../message-queue/message_queue.h"
+
+using namespace std;
+
+// ================== Messages =====================
+// A message is built once by the publisher and every matching subscriber's
+// queue holds a reference to the same immutable object.
+struct Message
+{
+    string topic;
+    string payload;
+    chrono::steady_clock::time_point published;
+};
+
+using MessagePtr = shared_ptr<const Message>;
+
+// ================== Subscriptions =====================
+// What happens when a subscriber's queue is full at publish time:
+// DropOldest throws away its oldest queued message to make room, Disconnect
+// closes the subscription so a stuck consumer cannot hold up the rest.
+enum class SlowConsumerPolicy
+{
+    DropOldest,
+    Disconnect
+};
+
+class Subscription
+{
+public:
+    Subscription(string prefix, size_t capacity, SlowConsumerPolicy policy)
+        : m_prefix(std::move(prefix)), m_policy(policy), m_queue(capacity) {}
+
+    // Waits for the next message. Throws std::runtime_error once the
+    // subscription is closed and drained.
+    MessagePtr next()
+    {
+        return m_queue.pop();
+    }
+
+    bool try_next(MessagePtr &msg)
+    {
+        return m_queue.try_pop(msg);
+    }
+
+    template <typename Rep, typename Period>
+    bool next_for(MessagePtr &msg, chrono::duration<Rep, Period> timeout)
+    {
+        return m_queue.pop_for(msg, timeout);
+    }
+
+    // Everything queued, in one lock acquisition; see MessageQueue::drain_into.
+    template <typename Container>
+    size_t drain_into(Container &out)
+    {
+        return m_queue.drain_into(out);
+    }
+
+    const string &prefix() const
+    {
+        return m_prefix;
+    }
+
+    // Messages this subscriber lost to DropOldest.
+    uint64_t dropped() const
+    {
+        return m_dropped.load(memory_order_relaxed);
+    }
+
+    // False once unsubscribed or disconnected as a slow consumer.
+    bool connected() const
+    {
+        return !m_queue.closed();
+    }
+
+private:
+    friend class Broker;
+
+    // Returns false if the subscriber should be dropped from the broker.
+    bool deliver(const MessagePtr &msg)
+    {
+        if (m_policy == SlowConsumerPolicy::DropOldest)
+        {
+            size_t dropped = 0;
+            bool open = m_queue.push_evicting(msg, dropped);
+            if (dropped)
+                m_dropped.fetch_add(dropped, memory_order_relaxed);
+            return open;
+        }
+        if (m_queue.try_push(msg))
+            return true;
+        m_queue.close();
+        return false;
+    }
+
+    void close()
+    {
+        m_queue.close();
+    }
+
+    const string m_prefix;
+    const SlowConsumerPolicy m_policy;
+    MessageQueue<MessagePtr> m_queue;
+    atomic<uint64_t> m_dropped{0};
+};
+
+using SubscriptionPtr = shared_ptr<Subscription>;
+
+// ================== Broker =====================
+// Subscribers are indexed by their prefix, so publishing to a topic costs one
+// hash lookup per prefix of the topic (topic length + 1 lookups) rather than
+// a scan over every subscriber. The index is copy-on-write: subscribe and
+// unsubscribe build a new one under a mutex, and publishers only hold that
+// mutex long enough to take a reference to the current one.
+class Broker
+{
+public:
+    Broker() : m_index(make_shared<const Index>()) {}
+
+    ~Broker()
+    {
+        for (auto &[prefix, subs] : *snapshot())
+            for (auto &sub : subs)
+                sub->close();
+    }
+
+    // Receives every message whose topic starts with `prefix` ("" for all).
+    SubscriptionPtr subscribe(string prefix, size_t capacity = 1024,
+                              SlowConsumerPolicy policy = SlowConsumerPolicy::DropOldest)
+    {
+        auto sub = make_shared<Subscription>(std::move(prefix), capacity, policy);
+        lock_guard<mutex> guard(m_indexMutex);
+        auto index = make_shared<Index>(*m_index);
+        (*index)[sub->prefix()].push_back(sub);
+        m_index = std::move(index);
+        return sub;
+    }
+
+    // Stops delivery and closes the subscription; already queued messages
+    // can still be drained.
+    void unsubscribe(const SubscriptionPtr &sub)
+    {
+        remove(sub);
+        sub->close();
+    }
+
+    // Publishes once to every matching subscriber. Returns how many received it.
+    size_t publish(string topic, string payload)
+    {
+        auto msg = make_shared<const Message>(Message{std::move(topic), std::move(payload), chrono::steady_clock::now()});
+        auto index = snapshot();
+
+        size_t delivered = 0;
+        string_view view = msg->topic;
+        for (size_t len = 0; len <= view.size(); len++)
+        {
+            auto it = index->find(view.substr(0, len));
+            if (it == index->end())
+                continue;
+            for (auto &sub : it->second)
+            {
+                if (sub->deliver(msg))
+                    delivered++;
+                else
+                    remove(sub); // disconnected as a slow consumer
+            }
+        }
+        return delivered;
+    }
+
+    size_t subscriber_count()
+    {
+        size_t n = 0;
+        for (auto &[prefix, subs] : *snapshot())
+            n += subs.size();
+        return n;
+    }
+
+private:
+    // heterogeneous lookup, so publish can probe with string_view prefixes
+    struct PrefixHash
+    {
+        using is_transparent = void;
+        size_t operator()(string_view s) const { return hash<string_view>{}(s); }
+    };
+
+    using Index = unordered_map<string, vector<SubscriptionPtr>, PrefixHash, equal_to<>>;
+
+    shared_ptr<const Index> snapshot()
+    {
+        lock_guard<mutex> guard(m_indexMutex);
+        return m_index;
+    }
+
+    void remove(const SubscriptionPtr &sub)
+    {
+        lock_guard<mutex> guard(m_indexMutex);
+        auto it = m_index->find(sub->prefix());
+        if (it == m_index->end() || find(it->second.begin(), it->second.end(), sub) == it->second.end())
+            return; // another publisher got there first
+
+        auto index = make_shared<Index>(*m_index);
+        auto &subs = (*index)[sub->prefix()];
+        subs.erase(find(subs.begin(), subs.end(), sub));
+        if (subs.empty())
+            index->erase(sub->prefix());
+        m_index = std::move(index);
+    }
+
+    mutex m_indexMutex;
+    shared_ptr<const Index> m_index;
+};
+
+// ================== Benchmark =====================
+// `publishers` threads publish market data ticks on "md.<symbol>" for 100
+// symbols. Every tenth subscriber takes the whole feed ("md."), the rest
+// follow one symbol each. `drainers` threads share the subscriptions
+// round-robin and record publish-to-receive latency for every message.
+struct BenchResult
+{
+    double publishedPerSec;
+    double deliveredPerSec;
+    double p50us;
+    double p99us;
+    uint64_t dropped;
+    size_t disconnected;
+};
+
+BenchResult run_benchmark(int subscribers, SlowConsumerPolicy policy, int publishers, int messagesPerPublisher)
+{
+    constexpr int symbols = 100;
+    constexpr int drainers = 4;
+
+    Broker broker;
+    vector<SubscriptionPtr> subs;
+    for (int s = 0; s < subscribers; s++)
+        subs.push_back(broker.subscribe(s % 10 == 0 ? "md." : "md.S" + to_string(s % symbols) + ".", 1024, policy));
+
+    atomic<bool> publishing{true};
+    atomic<uint64_t> delivered{0};
+    vector<vector<float>> latencies(drainers);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int d = 0; d < drainers; d++)
+    {
+        threads.emplace_back([&, d]
+                             {
+                                 auto &lat = latencies[d];
+                                 MessagePtr msg;
+                                 uint64_t received = 0;
+                                 while (true)
+                                 {
+                                     bool stopping = !publishing.load(memory_order_acquire);
+                                     bool idle = true;
+                                     for (size_t i = d; i < subs.size(); i += drainers)
+                                     {
+                                         while (subs[i]->try_next(msg))
+                                         {
+                                             idle = false;
+                                             received++;
+                                             // sample, storing every latency of millions of deliveries would dominate
+                                             if ((received & 63) == 0)
+                                                 lat.push_back(chrono::duration<float, micro>(chrono::steady_clock::now() - msg->published).count());
+                                         }
+                                     }
+                                     if (stopping && idle)
+                                         break;
+                                     if (idle)
+                                         this_thread::yield();
+                                 }
+                                 delivered.fetch_add(received, memory_order_relaxed); });
+    }
+
+    vector<thread> pubs;
+    for (int p = 0; p < publishers; p++)
+    {
+        pubs.emplace_back([&broker, p, messagesPerPublisher]
+                          {
+                              string payload(64, 'x');
+                              for (int i = 0; i < messagesPerPublisher; i++)
+                                  broker.publish("md.S" + to_string((i * 7 + p) % symbols) + ".trade", payload); });
+    }
+    for (auto &t : pubs)
+        t.join();
+    auto published = chrono::steady_clock::now();
+    publishing.store(false, memory_order_release);
+    for (auto &t : threads)
+        t.join();
+    auto end = chrono::steady_clock::now();
+
+    vector<float> all;
+    for (auto &lat : latencies)
+        all.insert(all.end(), lat.begin(), lat.end());
+    sort(all.begin(), all.end());
+
+    BenchResult result{};
+    result.publishedPerSec = static_cast<double>(publishers) * messagesPerPublisher / chrono::duration<double>(published - start).count();
+    result.deliveredPerSec = delivered.load() / chrono::duration<double>(end - start).count();
+    result.p50us = all.empty() ? 0 : all[all.size() / 2];
+    result.p99us = all.empty() ? 0 : all[all.size() * 99 / 100];
+    for (auto &sub : subs)
+    {
+        result.dropped += sub->dropped();
+        result.disconnected += !sub->connected();
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    {
+        Broker broker;
+        auto everything = broker.subscribe("");
+        auto trades = broker.subscribe("md.AAPL.");
+        auto slow = broker.subscribe("md.", 2, SlowConsumerPolicy::Disconnect);
+
+        broker.publish("md.AAPL.trade", "100@187.5");
+        broker.publish("md.MSFT.quote", "411.2/411.3");
+        broker.publish("ref.AAPL", "Apple Inc");
+
+        cout << "everything: " << everything->next()->topic << ", " << everything->next()->topic << ", "
+             << everything->next()->topic << "\n";
+        auto t = trades->next();
+        cout << "md.AAPL.:   " << t->topic << " " << t->payload << " (shared with " << t.use_count() - 1
+             << " other holders)\n";
+        cout << "slow md.:   connected = " << boolalpha << slow->connected() << " after 2 of 2 slots, ";
+        broker.publish("md.AAPL.trade", "200@187.6");
+        cout << "connected = " << slow->connected() << " after overflowing, " << broker.subscriber_count()
+             << " subscribers left\n";
+    }
+
+    int messages = argc > 1 ? stoi(argv[1]) : 50'000;
+    constexpr int publishers = 2;
+    cout << "\n"
+         << publishers * messages << " messages, 4 drainer threads, 1024-slot subscriber queues\n";
+    cout << "subscribers  policy       published/s  delivered/s  p50 us   p99 us   dropped  disconnected\n";
+    for (int subscribers : {10, 100, 1000, 5000})
+    {
+        for (auto policy : {SlowConsumerPolicy::DropOldest, SlowConsumerPolicy::Disconnect})
+        {
+            auto r = run_benchmark(subscribers, policy, publishers, messages);
+            cout << subscribers << "\t     " << (policy == SlowConsumerPolicy::DropOldest ? "drop-oldest" : "disconnect ")
+                 << "  " << r.publishedPerSec << "\t  " << r.deliveredPerSec << "\t" << r.p50us << "\t " << r.p99us
+                 << "\t  " << r.dropped << "\t   " << r.disconnected << "\n";
+        }
+    }
+
+    return 0;
+}
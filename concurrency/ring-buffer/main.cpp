@@ -3,9 +3,31 @@
 #include <atomic>
 #include <chrono>
 #include <cassert>
+#include <algorithm>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include "ring_buffer.h"
+
+// ================== Basic SPSC ring buffer (baseline) =====================
+// Loads the other side's index on every operation and moves one element at a
+// time. Kept as the baseline for the benchmark below.
 template <typename T, size_t SIZE>
-class RingBuffer
+class BasicRingBuffer
 {
     static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be power of two");
 
@@ -43,49 +65,615 @@ public:
     }
 };
 
-int main()
+// ================== Shared memory ring buffer =====================
+// Puts a RingBuffer in a shm_open/mmap segment so a producer process and a
+// consumer process exchange messages through it without copying them through
+// the kernel. The segment starts with a versioned header describing the
+// layout; open() refuses a segment written by a different build (other
+// element size, capacity or ring layout) instead of misreading it.
+//
+// Each side registers its pid in the header and stamps a heartbeat. The peer
+// is reported Dead once its pid is gone (kill(pid, 0) fails with ESRCH) and
+// Stalled once its heartbeat is older than the caller's timeout, which also
+// catches a peer that is alive but stuck. A pid can be recycled by the OS,
+// so a heartbeat timeout is the more reliable signal for long lived peers.
+// The blocking push_wait/pop_wait do not look at the peer; a side that must
+// not hang on a crashed peer polls push/pop and checks peer_state().
+//
+// Elements are copied as raw bytes between processes, so T must be
+// trivially copyable, and the ring has to use SharedFutexWait (or a spinning
+// strategy) since a private futex cannot wake another process.
+enum class PeerState
 {
-    constexpr size_t N = 1 << 20; // Ring buffer size (1M)
-    constexpr size_t total_messages = 100000000;
+    Absent,  // never attached, or detached cleanly
+    Alive,
+    Stalled, // heartbeat older than the timeout
+    Dead     // the process is gone
+};
+
+template <typename T, size_t SIZE, typename Wait = SharedFutexWait>
+class SharedRingBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "shared memory elements must be trivially copyable");
+    static_assert(std::atomic<size_t>::is_always_lock_free, "shared memory needs address-free atomics");
+    static_assert(!std::is_same_v<Wait, FutexWait>, "a private futex cannot wake another process");
+
+public:
+    using Ring = RingBuffer<T, SIZE, Wait>;
+
+    enum class Role
+    {
+        Producer,
+        Consumer
+    };
+
+    static constexpr uint32_t kMagic = 0x52425546; // "RBUF"
+    static constexpr uint32_t kVersion = 1;
+
+    // Creates the segment and attaches as `role`. Fails if it already exists.
+    static SharedRingBuffer create(const std::string &name, Role role)
+    {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            throw std::runtime_error("shm_open(" + name + ") failed: " + strerror(errno));
+        if (ftruncate(fd, kSegmentSize) != 0)
+        {
+            int err = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("ftruncate(" + name + ") failed: " + strerror(err));
+        }
+
+        SharedRingBuffer segment(name, fd, role, true);
+        auto *header = new (segment.m_base) Header{};
+        header->elementSize = sizeof(T);
+        header->capacity = SIZE;
+        header->ringSize = sizeof(Ring);
+        header->ringOffset = kRingOffset;
+        new (segment.m_base + kRingOffset) Ring();
+        header->version = kVersion;
+        // published last: open() treats a segment without the magic as not
+        // yet initialised
+        header->magic.store(kMagic, std::memory_order_release);
 
-    RingBuffer<int, N> rb;
+        segment.attach();
+        return segment;
+    }
+
+    // Opens a segment created by another process and attaches as `role`.
+    static SharedRingBuffer open(const std::string &name, Role role)
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            throw std::runtime_error("shm_open(" + name + ") failed: " + strerror(errno));
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != kSegmentSize)
+        {
+            close(fd);
+            throw std::runtime_error("shared ring " + name + " has an unexpected size");
+        }
+
+        SharedRingBuffer segment(name, fd, role, false);
+        const Header &header = segment.header();
+        if (header.magic.load(std::memory_order_acquire) != kMagic)
+            throw std::runtime_error("shared ring " + name + " is not initialised");
+        if (header.version != kVersion || header.elementSize != sizeof(T) || header.capacity != SIZE ||
+            header.ringSize != sizeof(Ring) || header.ringOffset != kRingOffset)
+            throw std::runtime_error("shared ring " + name + " has an incompatible layout");
+
+        segment.attach();
+        return segment;
+    }
 
-    std::atomic<bool> done{false};
-    std::atomic<size_t> produced{0}, consumed{0};
+    SharedRingBuffer(const SharedRingBuffer &) = delete;
+    SharedRingBuffer &operator=(const SharedRingBuffer &) = delete;
 
+    SharedRingBuffer(SharedRingBuffer &&other) noexcept
+        : m_name(std::move(other.m_name)), m_fd(other.m_fd), m_base(other.m_base),
+          m_role(other.m_role), m_owner(other.m_owner), m_attached(other.m_attached)
+    {
+        other.m_fd = -1;
+        other.m_base = nullptr;
+        other.m_owner = false;
+        other.m_attached = false;
+    }
+
+    SharedRingBuffer &operator=(SharedRingBuffer &&) = delete;
+
+    // Detaches; the creator also removes the name; a peer that still has the
+    // segment mapped keeps using it.
+    ~SharedRingBuffer()
+    {
+        if (m_base)
+        {
+            pid_t me = getpid();
+            if (m_attached)
+                self().pid.compare_exchange_strong(me, 0, std::memory_order_acq_rel);
+            munmap(m_base, kSegmentSize);
+        }
+        if (m_fd >= 0)
+            close(m_fd);
+        if (m_owner)
+            shm_unlink(m_name.c_str());
+    }
+
+    Ring &ring()
+    {
+        return *reinterpret_cast<Ring *>(m_base + kRingOffset);
+    }
+
+    // Call periodically (e.g. once per batch) so the peer can tell a stuck
+    // process from a slow one.
+    void heartbeat()
+    {
+        self().heartbeat.store(now_ns(), std::memory_order_relaxed);
+    }
+
+    PeerState peer_state(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) const
+    {
+        const Peer &peer = m_role == Role::Producer ? header().consumer : header().producer;
+        pid_t pid = peer.pid.load(std::memory_order_acquire);
+        if (pid == 0)
+            return PeerState::Absent;
+        if (kill(pid, 0) != 0 && errno == ESRCH)
+            return PeerState::Dead;
+        auto age = now_ns() - peer.heartbeat.load(std::memory_order_relaxed);
+        if (age > std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count())
+            return PeerState::Stalled;
+        return PeerState::Alive;
+    }
+
+private:
+    struct Peer
+    {
+        std::atomic<pid_t> pid{0};
+        std::atomic<int64_t> heartbeat{0}; // CLOCK_MONOTONIC, system wide
+    };
+
+    struct alignas(64) Header
+    {
+        std::atomic<uint32_t> magic{0};
+        uint32_t version = 0;
+        uint64_t elementSize = 0;
+        uint64_t capacity = 0;
+        uint64_t ringSize = 0;
+        uint64_t ringOffset = 0;
+        alignas(64) Peer producer;
+        alignas(64) Peer consumer;
+    };
+
+    static constexpr size_t kRingOffset = (sizeof(Header) + alignof(Ring) - 1) / alignof(Ring) * alignof(Ring);
+    static constexpr size_t kSegmentSize = kRingOffset + sizeof(Ring);
+
+    SharedRingBuffer(std::string name, int fd, Role role, bool owner)
+        : m_name(std::move(name)), m_fd(fd), m_role(role), m_owner(owner)
+    {
+        void *base = mmap(nullptr, kSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            int err = errno;
+            close(fd);
+            m_fd = -1;
+            if (owner)
+                shm_unlink(m_name.c_str());
+            m_owner = false;
+            throw std::runtime_error("mmap(" + m_name + ") failed: " + strerror(err));
+        }
+        m_base = static_cast<char *>(base);
+    }
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    Header &header() const
+    {
+        return *reinterpret_cast<Header *>(m_base);
+    }
+
+    Peer &self() const
+    {
+        return m_role == Role::Producer ? header().producer : header().consumer;
+    }
+
+    void attach()
+    {
+        pid_t current = 0;
+        while (!self().pid.compare_exchange_strong(current, getpid(), std::memory_order_acq_rel))
+        {
+            // a previous owner that died without detaching does not hold the role
+            if (!(kill(current, 0) != 0 && errno == ESRCH))
+                throw std::runtime_error("shared ring " + m_name + " already has a live " +
+                                         (m_role == Role::Producer ? "producer" : "consumer"));
+        }
+        m_attached = true;
+        heartbeat();
+    }
+
+    std::string m_name;
+    int m_fd = -1;
+    char *m_base = nullptr;
+    Role m_role;
+    bool m_owner;
+    bool m_attached = false;
+};
+
+// ================== Benchmark =====================
+// One producer and one consumer pass `total` sequential ints through the
+// buffer, the consumer validates the order.
+template <typename Ring>
+double single_ops_per_second(Ring &rb, size_t total)
+{
     auto start = std::chrono::high_resolution_clock::now();
 
     std::thread producer([&]()
                          {
-        for (size_t i = 0; i < total_messages; ) {
-            if (rb.push(i)) {
+        for (size_t i = 0; i < total; ) {
+            if (rb.push(i))
                 ++i;
-                ++produced;
-            }
         } });
 
     std::thread consumer([&]()
                          {
         size_t expected = 0;
         int val;
-        while (consumed < total_messages) {
+        while (expected < total) {
             if (rb.pop(val)) {
-                assert(val == expected);  // Validate order
+                assert(val == static_cast<int>(expected));  // Validate order
                 ++expected;
-                ++consumed;
             }
-        }
-        done = true; });
+        } });
+
+    producer.join();
+    consumer.join();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    return total / std::chrono::duration<double>(end - start).count();
+}
+
+template <typename Ring>
+double batched_ops_per_second(Ring &rb, size_t total, size_t batch)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::thread producer([&]()
+                         {
+        int items[1024];
+        for (size_t i = 0; i < total; ) {
+            size_t n = std::min(batch, total - i);
+            for (size_t k = 0; k < n; k++)
+                items[k] = static_cast<int>(i + k);
+            size_t sent = 0;
+            while (sent < n)
+                sent += rb.push_n(items + sent, n - sent);
+            i += n;
+        } });
+
+    std::thread consumer([&]()
+                         {
+        int items[1024];
+        size_t expected = 0;
+        while (expected < total) {
+            size_t n = rb.pop_n(items, batch);
+            for (size_t k = 0; k < n; k++, expected++)
+                assert(items[k] == static_cast<int>(expected));
+        } });
 
     producer.join();
     consumer.join();
 
     auto end = std::chrono::high_resolution_clock::now();
-    double seconds = std::chrono::duration<double>(end - start).count();
+    return total / std::chrono::duration<double>(end - start).count();
+}
+
+template <typename Ring>
+double span_ops_per_second(Ring &rb, size_t total, size_t batch)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::thread producer([&]()
+                         {
+        for (size_t i = 0; i < total; ) {
+            auto slots = rb.reserve(std::min(batch, total - i));
+            for (auto &slot : slots)
+                slot = static_cast<int>(i++);
+            rb.commit(slots.size());
+        } });
+
+    std::thread consumer([&]()
+                         {
+        size_t expected = 0;
+        while (expected < total) {
+            auto slots = rb.peek(batch);
+            for (int val : slots) {
+                assert(val == static_cast<int>(expected));
+                ++expected;
+            }
+            rb.consume(slots.size());
+        } });
+
+    producer.join();
+    consumer.join();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    return total / std::chrono::duration<double>(end - start).count();
+}
+
+// ================== Wait strategy benchmark =====================
+// Two scenarios per strategy. Light traffic: the producer sends a timestamp
+// every `interval` and the consumer records how long each one took to
+// arrive, which is what a mostly idle channel sees. Saturated: both sides go
+// flat out through a small ring, so they keep hitting empty and full. CPU is
+// process user+sys time over wall time, i.e. cores kept busy.
+struct StrategyResult
+{
+    double p50us;
+    double p99us;
+    double idleCores;
+    double opsPerSec;
+    double busyCores;
+};
+
+double cpu_seconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+template <typename Wait>
+StrategyResult measure_strategy(size_t pings, std::chrono::microseconds interval, size_t total)
+{
+    using Clock = std::chrono::steady_clock;
+    StrategyResult result{};
+
+    {
+        auto rb = std::make_unique<RingBuffer<int64_t, 1024, Wait>>();
+        std::vector<double> latencies(pings);
+
+        auto wallStart = Clock::now();
+        double cpuStart = cpu_seconds();
+        std::thread producer([&]()
+                             {
+            for (size_t i = 0; i < pings; i++) {
+                std::this_thread::sleep_for(interval);
+                rb->push_wait(Clock::now().time_since_epoch().count());
+            } });
+        std::thread consumer([&]()
+                             {
+            int64_t sent = 0;
+            for (size_t i = 0; i < pings; i++) {
+                rb->pop_wait(sent);
+                latencies[i] = (Clock::now().time_since_epoch().count() - sent) / 1e3;
+            } });
+        producer.join();
+        consumer.join();
+        double wall = std::chrono::duration<double>(Clock::now() - wallStart).count();
+
+        std::sort(latencies.begin(), latencies.end());
+        result.p50us = latencies[pings / 2];
+        result.p99us = latencies[pings * 99 / 100];
+        result.idleCores = (cpu_seconds() - cpuStart) / wall;
+    }
+
+    {
+        auto rb = std::make_unique<RingBuffer<int64_t, 1024, Wait>>();
+
+        auto wallStart = Clock::now();
+        double cpuStart = cpu_seconds();
+        std::thread producer([&]()
+                             {
+            for (size_t i = 0; i < total; i++)
+                rb->push_wait(i); });
+        std::thread consumer([&]()
+                             {
+            int64_t val = 0;
+            for (size_t i = 0; i < total; i++) {
+                rb->pop_wait(val);
+                assert(val == static_cast<int64_t>(i));
+            } });
+        producer.join();
+        consumer.join();
+        double wall = std::chrono::duration<double>(Clock::now() - wallStart).count();
+
+        result.opsPerSec = total / wall;
+        result.busyCores = (cpu_seconds() - cpuStart) / wall;
+    }
+
+    return result;
+}
+
+template <typename Wait>
+void report_strategy(const char *name, size_t total)
+{
+    auto r = measure_strategy<Wait>(2000, std::chrono::microseconds(200), total);
+    std::cout << name << r.p50us << "us\t" << r.p99us << "us\t" << r.idleCores << "\t\t"
+              << r.opsPerSec << "\t" << r.busyCores << "\n";
+}
+
+// ================== Cross-process demo =====================
+// The parent creates the segment and produces, a forked child opens it by
+// name and consumes, validating order. Then a consumer that hangs and gets
+// killed shows the peer states the producer sees.
+using ShmRing = SharedRingBuffer<int64_t, 1 << 16>;
+
+const char *peer_state_name(PeerState state)
+{
+    switch (state)
+    {
+    case PeerState::Absent:
+        return "absent";
+    case PeerState::Alive:
+        return "alive";
+    case PeerState::Stalled:
+        return "stalled";
+    case PeerState::Dead:
+        return "dead";
+    }
+    return "?";
+}
+
+void cross_process_demo(size_t total)
+{
+    std::string name = "/ring-buffer-demo-" + std::to_string(getpid());
+    auto producer = ShmRing::create(name, ShmRing::Role::Producer);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        int status = 0;
+        try
+        {
+            auto consumer = ShmRing::open(name, ShmRing::Role::Consumer);
+            int64_t val = 0;
+            for (size_t i = 0; i < total && status == 0; i++)
+            {
+                consumer.ring().pop_wait(val);
+                if (val != static_cast<int64_t>(i))
+                    status = 1;
+                if ((i & 0xffff) == 0)
+                    consumer.heartbeat();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "consumer: " << e.what() << "\n";
+            status = 2;
+        }
+        _exit(status); // skip the destructors of the parent's objects
+    }
+
+    for (size_t i = 0; i < total; i++)
+    {
+        producer.ring().push_wait(static_cast<int64_t>(i));
+        if ((i & 0xffff) == 0)
+            producer.heartbeat();
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "\ncross-process: " << total << " messages, "
+              << (WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "in order" : "CONSUMER FAILED") << ", "
+              << total / std::chrono::duration<double>(end - start).count() << " ops/sec\n";
+    std::cout << "consumer after clean exit: " << peer_state_name(producer.peer_state()) << "\n";
+
+    child = fork();
+    if (child == 0)
+    {
+        auto consumer = ShmRing::open(name, ShmRing::Role::Consumer);
+        pause(); // hang without heartbeats until killed
+        _exit(0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::cout << "hung consumer: " << peer_state_name(producer.peer_state()) << " after 50ms, ";
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::cout << peer_state_name(producer.peer_state(std::chrono::milliseconds(100)))
+              << " after 250ms with a 100ms timeout, ";
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0); // until reaped a zombie still answers kill(pid, 0)
+    std::cout << peer_state_name(producer.peer_state()) << " once killed\n";
+
+    // the dead consumer never detached, a replacement can still take over
+    auto replacement = ShmRing::open(name, ShmRing::Role::Consumer);
+    std::cout << "replacement consumer: " << peer_state_name(producer.peer_state()) << "\n";
+}
+
+// ================== Mapped storage benchmark =====================
+// Runs the single element harness over a runtime sized MappedRingBuffer with
+// each page setup, counting the page faults taken while it runs and the time
+// spent building the ring (which is where prefaulting pays).
+long minor_faults()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+const char *huge_pages_name(HugePages mode)
+{
+    switch (mode)
+    {
+    case HugePages::None:
+        return "4K pages";
+    case HugePages::Transparent:
+        return "THP";
+    case HugePages::Explicit:
+        return "hugetlb";
+    }
+    return "?";
+}
+
+void mapped_storage_benchmark(size_t capacity, size_t total)
+{
+    struct Config
+    {
+        const char *name;
+        MappedStorageOptions options;
+    };
+    const Config configs[] = {
+        {"4K, no prefault  ", {HugePages::None, false}},
+        {"4K, prefault     ", {HugePages::None, true}},
+        {"THP, prefault    ", {HugePages::Transparent, true}},
+        {"hugetlb, prefault", {HugePages::Explicit, true}},
+    };
+
+    std::cout << "\nMappedRingBuffer<int>, " << capacity << " slots requested\n";
+    std::cout << "storage             granted   setup ms  ops/sec      faults during run\n";
+    for (const auto &config : configs)
+    {
+        auto setupStart = std::chrono::high_resolution_clock::now();
+        auto rb = std::make_unique<MappedRingBuffer<int>>(capacity, config.options);
+        double setupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - setupStart).count();
+
+        long faults = minor_faults();
+        double ops = single_ops_per_second(*rb, total);
+        faults = minor_faults() - faults;
+
+        std::cout << config.name << "   " << huge_pages_name(rb->get_storage().huge_pages()) << "\t  "
+                  << setupMs << "\t    " << ops << "  " << faults << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    constexpr size_t N = 1 << 20; // Ring buffer size (1M)
+    const size_t total_messages = argc > 1 ? std::stoul(argv[1]) : 100000000;
+    constexpr size_t batch = 256;
+
+    // a 1M slot buffer is too big for the stack
+    auto basic = std::make_unique<BasicRingBuffer<int, N>>();
+    auto cached = std::make_unique<RingBuffer<int, N>>();
+
+    std::cout << "Processing " << total_messages << " messages\n";
+    std::cout << "baseline push/pop:      " << single_ops_per_second(*basic, total_messages) << " ops/sec\n";
+    std::cout << "cached-index push/pop:  " << single_ops_per_second(*cached, total_messages) << " ops/sec\n";
+
+    cached = std::make_unique<RingBuffer<int, N>>();
+    std::cout << "push_n/pop_n x" << batch << ":     " << batched_ops_per_second(*cached, total_messages, batch) << " ops/sec\n";
+
+    cached = std::make_unique<RingBuffer<int, N>>();
+    std::cout << "reserve/commit x" << batch << ":   " << span_ops_per_second(*cached, total_messages, batch) << " ops/sec\n";
+
+    std::cout << "\nstrategy      light traffic p50/p99   cores    saturated ops/sec   cores\n";
+    // capped: the spinning strategies crawl once there are fewer cores than threads
+    const size_t strategy_messages = std::min<size_t>(total_messages, 1000000);
+    report_strategy<BusySpinWait>("busy-spin     ", strategy_messages);
+    report_strategy<PauseSpinWait>("spin+pause    ", strategy_messages);
+    report_strategy<YieldWait>("spin+yield    ", strategy_messages);
+    report_strategy<FutexWait>("futex         ", strategy_messages);
+
+    cross_process_demo(std::min<size_t>(total_messages, 10000000));
 
-    std::cout << "Processed " << total_messages << " messages in "
-              << seconds << " seconds (" << (total_messages / seconds)
-              << " ops/sec)\n";
+    // capacity from the command line, the way a service would size it from config
+    const size_t mapped_capacity = argc > 2 ? std::stoul(argv[2]) : size_t(1) << 24;
+    mapped_storage_benchmark(mapped_capacity, std::min<size_t>(total_messages, 50000000));
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <span>
+#include <memory>
+#include <bit>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ================== Wait strategies =====================
+// How push_wait() and pop_wait() wait for room or data. A ring holds one
+// strategy object per direction: wait(ready) is called by the side that is
+// stuck and returns once ready() holds, notify() is called by the other side
+// after every push or pop.
+//
+//   BusySpinWait   reloads the index in a tight loop. Lowest latency, burns
+//                  a core.
+//   PauseSpinWait  the same with a pause instruction per iteration, which is
+//                  kinder to a hyperthread sibling and to the memory bus.
+//   YieldWait      spins briefly, then yields the CPU between checks.
+//   FutexWait      spins, yields, then parks on a futex. notify() is a fence
+//                  and a load of a flag that is only set while the other side
+//                  is parked, and the other side only parks when the ring is
+//                  empty (or full), so the futex is only ever woken on an
+//                  empty->non-empty or full->non-full transition.
+//   SharedFutexWait  FutexWait with a process-shared futex, for rings that
+//                  live in shared memory.
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+struct BusySpinWait
+{
+    template <typename Ready>
+    void wait(Ready &&ready)
+    {
+        while (!ready())
+        {
+        }
+    }
+
+    void notify() {}
+};
+
+struct PauseSpinWait
+{
+    template <typename Ready>
+    void wait(Ready &&ready)
+    {
+        while (!ready())
+            cpu_relax();
+    }
+
+    void notify() {}
+};
+
+struct YieldWait
+{
+    static constexpr int kSpins = 64;
+
+    template <typename Ready>
+    void wait(Ready &&ready)
+    {
+        for (int i = 0; i < kSpins; i++)
+        {
+            if (ready())
+                return;
+            cpu_relax();
+        }
+        while (!ready())
+            std::this_thread::yield();
+    }
+
+    void notify() {}
+};
+
+template <bool Shared>
+class BasicFutexWait
+{
+    static constexpr int kWaitOp = Shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+    static constexpr int kWakeOp = Shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+
+public:
+    static constexpr int kSpins = 64;
+    static constexpr int kYields = 16;
+
+    template <typename Ready>
+    void wait(Ready &&ready)
+    {
+        for (int i = 0; i < kSpins; i++)
+        {
+            if (ready())
+                return;
+            cpu_relax();
+        }
+        for (int i = 0; i < kYields; i++)
+        {
+            if (ready())
+                return;
+            std::this_thread::yield();
+        }
+
+        while (true)
+        {
+            // announce ourselves before the last check; pairs with the fence
+            // in notify() so either we see the new index or it sees the flag
+            m_parked.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready())
+            {
+                m_parked.store(0, std::memory_order_relaxed);
+                return;
+            }
+            syscall(SYS_futex, &m_parked, kWaitOp, 1, nullptr, nullptr, 0);
+        }
+    }
+
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_relaxed) == 0)
+            return;
+        m_parked.store(0, std::memory_order_relaxed);
+        syscall(SYS_futex, &m_parked, kWakeOp, 1, nullptr, nullptr, 0);
+    }
+
+private:
+    std::atomic<uint32_t> m_parked{0};
+};
+
+using FutexWait = BasicFutexWait<false>;
+using SharedFutexWait = BasicFutexWait<true>;
+
+// ================== Ring storage =====================
+// Slots kept inside the ring object. The capacity is a compile time power of
+// two, so the masking folds into constants, and the ring is self contained,
+// which is what lets SharedRingBuffer place it in shared memory.
+template <typename T, size_t SIZE>
+class InlineStorage
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be power of two");
+
+public:
+    T *data()
+    {
+        return buffer;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return SIZE;
+    }
+
+    static constexpr size_t mask()
+    {
+        return SIZE - 1;
+    }
+
+private:
+    T buffer[SIZE];
+};
+
+// Slots in their own anonymous mapping, with the capacity chosen at runtime
+// (rounded up to a power of two) so a ring of millions of slots neither sits
+// on the stack nor needs to be known at compile time.
+//
+// HugePages::Transparent asks for transparent huge pages with madvise,
+// HugePages::Explicit asks for MAP_HUGETLB from the reserved pool and falls
+// back to transparent ones when the pool is empty (check huge_pages() to see
+// what was granted). Either way one 2MB TLB entry then covers what would take
+// 512 with 4K pages, so a large ring stops missing the TLB as the indices
+// sweep through it. With prefault every page is touched up front, so the
+// first lap around the ring does not take a page fault per 4K of slots.
+enum class HugePages
+{
+    None,
+    Transparent,
+    Explicit
+};
+
+struct MappedStorageOptions
+{
+    HugePages hugePages = HugePages::Transparent;
+    bool prefault = true;
+};
+
+template <typename T>
+class MappedStorage
+{
+public:
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    explicit MappedStorage(size_t capacity, MappedStorageOptions options = {})
+        : m_capacity(std::bit_ceil(std::max<size_t>(capacity, 2)))
+    {
+        m_bytes = (m_capacity * sizeof(T) + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+
+        void *p = MAP_FAILED;
+        if (options.hugePages == HugePages::Explicit)
+        {
+            p = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            m_hugePages = p != MAP_FAILED ? HugePages::Explicit : HugePages::None;
+        }
+        if (p == MAP_FAILED)
+        {
+            p = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::runtime_error(std::string("mmap of ring storage failed: ") + strerror(errno));
+            // has to come before the pages are first touched
+            if (options.hugePages != HugePages::None && madvise(p, m_bytes, MADV_HUGEPAGE) == 0)
+                m_hugePages = HugePages::Transparent;
+        }
+        m_data = static_cast<T *>(p);
+
+        if (options.prefault)
+        {
+            auto *bytes = static_cast<volatile char *>(p);
+            // Only MAP_HUGETLB guarantees 2MB pages. After madvise the kernel
+            // may still back the (not 2MB aligned) mapping with base pages,
+            // so touch every one of those.
+            size_t page = m_hugePages == HugePages::Explicit ? kHugePageSize : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t off = 0; off < m_bytes; off += page)
+                bytes[off] = 0;
+        }
+        std::uninitialized_default_construct_n(m_data, m_capacity);
+    }
+
+    ~MappedStorage()
+    {
+        std::destroy_n(m_data, m_capacity);
+        munmap(m_data, m_bytes);
+    }
+
+    MappedStorage(const MappedStorage &) = delete;
+    MappedStorage &operator=(const MappedStorage &) = delete;
+
+    T *data()
+    {
+        return m_data;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t mask() const
+    {
+        return m_capacity - 1;
+    }
+
+    // What was granted: Explicit only if MAP_HUGETLB succeeded, Transparent
+    // if the kernel accepted the madvise (it may still use 4K pages when it
+    // cannot find contiguous memory).
+    HugePages huge_pages() const
+    {
+        return m_hugePages;
+    }
+
+private:
+    T *m_data = nullptr;
+    size_t m_capacity;
+    size_t m_bytes = 0;
+    HugePages m_hugePages = HugePages::None;
+};
+
+// ================== SPSC ring buffer =====================
+// Each side keeps a private copy of the other side's index next to its own
+// and only reloads the shared one when the buffer looks full (producer) or
+// empty (consumer), so in steady state an operation touches no cache line
+// the other core is writing. Indices only ever grow; since there is a single
+// writer per index they are published with a plain release store.
+//
+// Besides single element push/pop there are bulk push_n/pop_n and zero-copy
+// spans: reserve() hands the producer free slots to fill in place and
+// commit() publishes them, peek() hands the consumer filled slots to read in
+// place and consume() frees them. Spans never wrap, so they may be shorter
+// than asked for near the end of the buffer.
+//
+// push_wait() and pop_wait() block according to the Wait strategy; every
+// operation that frees or fills slots notifies the other side, which is free
+// for the spinning strategies.
+//
+// Where the slots live is up to the Storage policy: InlineStorage keeps them
+// in the object with a compile time capacity (RingBuffer), MappedStorage
+// mmaps them with a capacity picked at runtime (MappedRingBuffer).
+template <typename T, typename Storage, typename Wait = BusySpinWait>
+class SpscRing
+{
+private:
+    Storage storage;
+
+    alignas(64) std::atomic<size_t> head{0}; // written by the producer
+    size_t cachedTail = 0;                   // producer's last view of tail
+
+    alignas(64) std::atomic<size_t> tail{0}; // written by the consumer
+    size_t cachedHead = 0;                   // consumer's last view of head
+
+    alignas(64) Wait notEmpty; // the consumer waits here for data
+    alignas(64) Wait notFull;  // the producer waits here for room
+
+    // producer side: free slots, reloading tail only if fewer than `wanted`
+    size_t free_slots(size_t h, size_t wanted)
+    {
+        size_t available = storage.capacity() - (h - cachedTail);
+        if (available < wanted)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            available = storage.capacity() - (h - cachedTail);
+        }
+        return available;
+    }
+
+    // consumer side: filled slots, reloading head only if fewer than `wanted`
+    size_t filled_slots(size_t t, size_t wanted)
+    {
+        size_t available = cachedHead - t;
+        if (available < wanted)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            available = cachedHead - t;
+        }
+        return available;
+    }
+
+public:
+    SpscRing() = default;
+
+    // Forwards to the Storage constructor, e.g. a runtime capacity.
+    template <typename... Args>
+    explicit SpscRing(Args &&...args) : storage(std::forward<Args>(args)...)
+    {
+    }
+
+    size_t capacity() const
+    {
+        return storage.capacity();
+    }
+
+    const Storage &get_storage() const
+    {
+        return storage;
+    }
+
+    bool push(const T &item)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (free_slots(h, 1) == 0)
+            return false;
+
+        storage.data()[h & storage.mask()] = item;
+        head.store(h + 1, std::memory_order_release);
+        notEmpty.notify();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (filled_slots(t, 1) == 0)
+            return false;
+
+        item = storage.data()[t & storage.mask()];
+        tail.store(t + 1, std::memory_order_release);
+        notFull.notify();
+        return true;
+    }
+
+    // Pushes item, waiting for room if the buffer is full.
+    void push_wait(const T &item)
+    {
+        if (push(item))
+            return;
+        notFull.wait([this]
+                     { return free_slots(head.load(std::memory_order_relaxed), 1) > 0; });
+        push(item);
+    }
+
+    // Pops into item, waiting for data if the buffer is empty.
+    void pop_wait(T &item)
+    {
+        if (pop(item))
+            return;
+        notEmpty.wait([this]
+                      { return filled_slots(tail.load(std::memory_order_relaxed), 1) > 0; });
+        pop(item);
+    }
+
+    // Pushes up to n items, returns how many were pushed.
+    size_t push_n(const T *items, size_t n)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        n = std::min(n, free_slots(h, n));
+        if (n == 0)
+            return 0;
+
+        size_t first = std::min(n, storage.capacity() - (h & storage.mask()));
+        std::copy(items, items + first, storage.data() + (h & storage.mask()));
+        std::copy(items + first, items + n, storage.data());
+        head.store(h + n, std::memory_order_release);
+        notEmpty.notify();
+        return n;
+    }
+
+    // Pops up to n items into out, returns how many were popped.
+    size_t pop_n(T *out, size_t n)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        n = std::min(n, filled_slots(t, n));
+        if (n == 0)
+            return 0;
+
+        size_t first = std::min(n, storage.capacity() - (t & storage.mask()));
+        std::copy(storage.data() + (t & storage.mask()), storage.data() + (t & storage.mask()) + first, out);
+        std::copy(storage.data(), storage.data() + (n - first), out + first);
+        tail.store(t + n, std::memory_order_release);
+        notFull.notify();
+        return n;
+    }
+
+    // Up to n contiguous free slots for the producer to write in place.
+    std::span<T> reserve(size_t n)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        n = std::min({n, free_slots(h, n), storage.capacity() - (h & storage.mask())});
+        return std::span<T>(storage.data() + (h & storage.mask()), n);
+    }
+
+    // Publishes the first n slots of the last reserve().
+    void commit(size_t n)
+    {
+        head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        notEmpty.notify();
+    }
+
+    // Up to n contiguous filled slots for the consumer to read in place.
+    std::span<const T> peek(size_t n)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        n = std::min({n, filled_slots(t, n), storage.capacity() - (t & storage.mask())});
+        return std::span<const T>(storage.data() + (t & storage.mask()), n);
+    }
+
+    // Frees the first n slots of the last peek().
+    void consume(size_t n)
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        notFull.notify();
+    }
+};
+
+template <typename T, size_t SIZE, typename Wait = BusySpinWait>
+using RingBuffer = SpscRing<T, InlineStorage<T, SIZE>, Wait>;
+
+template <typename T, typename Wait = BusySpinWait>
+using MappedRingBuffer = SpscRing<T, MappedStorage<T>, Wait>;
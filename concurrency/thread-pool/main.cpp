@@ -1,20 +1,37 @@
 #include <iostream>
 #include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#include "thread_pool.h"
 
 using namespace std;
 
-class ThreadPool
+// ================== Single queue ThreadPool (baseline) =====================
+// The original design: one queue and one mutex shared by every submitter and
+// every worker. Kept around as the baseline for the benchmark below.
+class SingleQueueThreadPool
 {
 public:
     using Task = function<void()>;
 
-    ThreadPool(int n = thread::hardware_concurrency()) : m_active(true), m_numThreads(n)
+    SingleQueueThreadPool(int n = thread::hardware_concurrency()) : m_numThreads(n), m_active(true)
     {
         for (int i = 0; i < m_numThreads; i++)
             this->add_worker();
     }
 
-    ~ThreadPool()
+    ~SingleQueueThreadPool()
     {
         this->shutdown();
     }
@@ -37,7 +54,7 @@ public:
     void submit_task(Task task)
     {
         lock_guard<mutex> guard(m_queueMutex);
-        m_taskQueue.push(task);
+        m_taskQueue.push(std::move(task));
         m_conditionVar.notify_one();
     }
 
@@ -48,7 +65,7 @@ public:
                             { return !m_taskQueue.empty() || !m_active; });
         if (!m_active && m_taskQueue.empty())
             return nullptr;
-        auto task = m_taskQueue.front();
+        auto task = std::move(m_taskQueue.front());
         m_taskQueue.pop();
         return task;
     }
@@ -79,21 +96,290 @@ private:
     condition_variable m_conditionVar;
 };
 
-int main()
+// ================== Allocation counter =====================
+// Counts every global operator new so the benchmark can show that steady
+// state submission stays off the heap.
+static atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// ================== Benchmark =====================
+// Each root task is submitted from outside the pool and fans out into
+// `children` short tasks submitted from inside it, the typical shape of a
+// batch job. Reports completed tasks per second. `instrument` switches the
+// ThreadPool's timing histograms on or off.
+template <typename Pool>
+double tasks_per_second(int threads, int roots, int children, bool instrument = true)
 {
-    ThreadPool pool(4);
+    const ptrdiff_t total = static_cast<ptrdiff_t>(roots) * (children + 1);
+    latch done(total);
+    atomic<uint64_t> sink{0};
 
-    for (int i = 0; i < 10; ++i)
+    auto start = chrono::high_resolution_clock::now();
     {
-        pool.submit_task([i]()
+        Pool pool(threads);
+        if constexpr (is_same_v<Pool, ThreadPool>)
+            pool.set_instrumentation(instrument);
+        for (int r = 0; r < roots; r++)
+        {
+            pool.submit_task([&pool, &done, &sink, children, r]
+                             {
+                                 for (int c = 0; c < children; c++)
+                                 {
+                                     pool.submit_task([&done, &sink, c]
+                                                      {
+                                                          sink.fetch_add(c, memory_order_relaxed);
+                                                          done.count_down(); });
+                                 }
+                                 sink.fetch_add(r, memory_order_relaxed);
+                                 done.count_down(); });
+        }
+        done.wait();
+    }
+    auto end = chrono::high_resolution_clock::now();
+
+    return total / chrono::duration<double>(end - start).count();
+}
+
+// ================== Priority benchmark =====================
+// Floods the pool with bulk tasks of ~200us each while a client submits a
+// short request every 500us, and records how long each request waited
+// between submission and start. Without lanes the requests queue behind the
+// flood; with the flood in the Low lane and requests in the High lane their
+// wait should stay flat.
+struct RequestLatency
+{
+    double p50;
+    double p99;
+    LaneStats low;
+};
+
+RequestLatency request_latency(int threads, bool prioritized)
+{
+    using Clock = chrono::steady_clock;
+    constexpr int bulkTasks = 2'000;
+    constexpr int requests = 200;
+
+    auto busy = [](chrono::microseconds d)
+    {
+        auto until = Clock::now() + d;
+        while (Clock::now() < until)
+        {
+        }
+    };
+
+    vector<double> waits(requests);
+    latch done(requests);
+    RequestLatency result{};
+    {
+        ThreadPool pool(threads);
+        for (int i = 0; i < bulkTasks; i++)
+        {
+            auto bulk = [busy]
+            { busy(chrono::microseconds(200)); };
+            if (prioritized)
+                pool.submit_task(bulk, Priority::Low);
+            else
+                pool.submit_task(bulk);
+        }
+
+        for (int r = 0; r < requests; r++)
+        {
+            auto submitted = Clock::now();
+            auto request = [&waits, &done, r, submitted]
+            {
+                waits[r] = chrono::duration<double, micro>(Clock::now() - submitted).count();
+                done.count_down();
+            };
+            if (prioritized)
+                pool.submit_task(request, Priority::High);
+            else
+                pool.submit_task(request);
+            this_thread::sleep_for(chrono::microseconds(500));
+        }
+        done.wait();
+        result.low = pool.lane_stats(Priority::Low);
+        // the destructor lets the rest of the flood drain
+    }
+
+    sort(waits.begin(), waits.end());
+    result.p50 = waits[requests / 2];
+    result.p99 = waits[requests * 99 / 100];
+    return result;
+}
+
+// ================== Elastic sizing demo =====================
+// A burst of sleeping tasks makes the pool grow towards maxThreads; once it
+// is over the extra workers idle out and the pool shrinks back to minThreads.
+void elastic_demo()
+{
+    ThreadPoolOptions options;
+    options.minThreads = 1;
+    options.maxThreads = 8;
+    options.idleTimeout = chrono::milliseconds(100);
+    options.growThreshold = 2;
+    options.numaNode = 0; // keep the workers on the first NUMA node
+
+    cout << "\nNUMA node 0 has " << numa_node_cpus(0).size() << " CPUs\n";
+
+    ThreadPool pool(options);
+    latch done(64);
+    for (int i = 0; i < 64; i++)
+        pool.submit_task([&done]
                          {
-                             cout << "Task " << i << " is being processed by thread "
-                                  << this_thread::get_id() << endl;
-                             this_thread::sleep_for(chrono::milliseconds(100)); });
+                             this_thread::sleep_for(chrono::milliseconds(10));
+                             done.count_down(); });
+
+    cout << "workers during burst: " << pool.num_workers();
+    done.wait();
+    cout << ", after burst: " << pool.num_workers();
+    this_thread::sleep_for(chrono::milliseconds(500));
+    cout << ", after idling: " << pool.num_workers() << "\n";
+}
+
+int main()
+{
+    {
+        ThreadPool pool(4);
+        vector<TaskFuture<int>> results;
+
+        for (int i = 0; i < 10; ++i)
+        {
+            results.push_back(pool.submit([](int i)
+                                          {
+                                              cout << "Task " << i << " is being processed by thread "
+                                                   << this_thread::get_id() << endl;
+                                              this_thread::sleep_for(chrono::milliseconds(100));
+                                              return i * i; },
+                                          i));
+        }
+
+        int sum = 0;
+        for (auto &result : results)
+            sum += result.get();
+        cout << "Sum of squares: " << sum << endl;
+
+        // three stage pipeline: load -> 4 parallel transforms -> reduce
+        vector<int> data(1000);
+        vector<long> partial(4);
+        long total = 0;
+
+        TaskGraph graph;
+        auto load = graph.add([&]
+                              {
+                                  for (size_t i = 0; i < data.size(); i++)
+                                      data[i] = static_cast<int>(i); });
+        auto reduce = graph.add([&]
+                                {
+                                    for (long p : partial)
+                                        total += p; });
+        for (size_t part = 0; part < partial.size(); part++)
+        {
+            auto transform = graph.add([&, part]
+                                       {
+                                           size_t chunk = data.size() / partial.size();
+                                           for (size_t i = part * chunk; i < (part + 1) * chunk; i++)
+                                               partial[part] += 2L * data[i]; });
+            graph.precede(load, transform);
+            graph.precede(transform, reduce);
+        }
+
+        graph.run(pool).get();
+        cout << "Pipeline result: " << total << " (expected " << 999L * 1000 << ")" << endl;
+
+        pool.shutdown();
     }
 
-    // Give some time for tasks to complete before shutdown
-    this_thread::sleep_for(chrono::seconds(2));
-    pool.shutdown();
+    elastic_demo();
+
+    {
+        // warm the node pool and the deques, then count what a later round costs:
+        // nothing, as long as it keeps no more tasks in flight than the node
+        // pool has grown to hold (see TaskNodePool)
+        constexpr int rounds = 100'000;
+        ThreadPool pool(4);
+        for (int pass = 0; pass < 3; pass++)
+        {
+            latch done(rounds);
+            auto before = g_allocations.load();
+            for (int i = 0; i < rounds; i++)
+                pool.submit_task([&done]
+                                 { done.count_down(); });
+            done.wait();
+            if (pass == 2)
+                cout << "\nHeap allocations for " << rounds << " warm submits: "
+                     << g_allocations.load() - before << "\n";
+        }
+    }
+
+    constexpr int roots = 2'000;
+    constexpr int children = 100;
+
+    cout << "\nthreads  single-queue tasks/s  work-stealing tasks/s\n";
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        double single = tasks_per_second<SingleQueueThreadPool>(threads, roots, children);
+        double stealing = tasks_per_second<ThreadPool>(threads, roots, children);
+        cout << threads << "\t " << single << "\t\t" << stealing << "\n";
+    }
+
+    // the tasks here are nearly empty, so the relative overhead is a worst
+    // case; the absolute cost per task is the number that carries over
+    cout << "\nthreads  uninstrumented tasks/s  instrumented tasks/s  overhead per task\n";
+    for (int threads = 1; threads <= 16; threads *= 4)
+    {
+        // best of three to keep scheduler noise out of a small difference
+        double off = 0, on = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            off = max(off, tasks_per_second<ThreadPool>(threads, roots, children, false));
+            on = max(on, tasks_per_second<ThreadPool>(threads, roots, children, true));
+        }
+        cout << threads << "\t " << off << "\t\t  " << on << "\t\t" << (1 / on - 1 / off) * 1e9 << "ns ("
+             << (off / on - 1) * 100 << "%)\n";
+    }
+
+    {
+        ThreadPool pool(4);
+        latch done(10'000);
+        for (int i = 0; i < 10'000; i++)
+            pool.submit_task([&done, i]
+                             {
+                                 // a prime period, so the slow tasks don't line up with the sampling
+                                 if (i % 101 == 0)
+                                     this_thread::sleep_for(chrono::microseconds(100));
+                                 done.count_down(); },
+                             i % 10 == 0 ? Priority::High : Priority::Normal);
+        done.wait();
+        auto snap = pool.snapshot();
+        cout << "\n"
+             << snap.to_text() << snap.to_json() << "\n";
+    }
+
+    int threads = max(thread::hardware_concurrency(), 2u);
+    auto fifo = request_latency(threads, false);
+    auto lanes = request_latency(threads, true);
+    cout << "\nRequest wait under a bulk flood, " << threads << " threads\n";
+    cout << "single lane:   p50 " << fifo.p50 << "us  p99 " << fifo.p99 << "us\n";
+    cout << "priority lanes: p50 " << lanes.p50 << "us  p99 " << lanes.p99 << "us\n";
+    cout << "low lane: max depth " << lanes.low.maxDepth << ", executed " << lanes.low.executed
+         << " while requests ran, promoted " << lanes.low.promoted << "\n";
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1558 @@
+#pragma once
+
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <variant>
+#include <optional>
+#include <type_traits>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <array>
+#include <bit>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// ================== Chase-Lev work-stealing deque =====================
+// The owning worker pushes and pops at the bottom (LIFO, cache-hot work first),
+// every other worker steals from the top (FIFO, oldest and usually biggest work).
+// push/pop must only be called by the owner, steal is safe from any thread.
+// Retired arrays are kept alive until destruction since a thief may still be
+// reading from one after the owner has grown the deque.
+template <typename T>
+class WorkStealingDeque
+{
+    static_assert(std::is_pointer_v<T>, "WorkStealingDeque stores raw pointers");
+
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) : m_top(0), m_bottom(0), m_array(new Array(capacity)) {}
+
+    ~WorkStealingDeque()
+    {
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    void push(T item)
+    {
+        auto b = m_bottom.load(std::memory_order_relaxed);
+        auto t = m_top.load(std::memory_order_acquire);
+        Array *a = m_array.load(std::memory_order_relaxed);
+
+        if (b - t > static_cast<int64_t>(a->capacity) - 1)
+            a = grow(a, t, b);
+
+        a->put(b, item);
+        m_bottom.store(b + 1, std::memory_order_release);
+    }
+
+    T pop()
+    {
+        auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // empty, restore bottom
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T item = a->get(b);
+        if (t == b)
+        {
+            // last element, race against thieves for it
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T steal()
+    {
+        auto t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return nullptr;
+
+        Array *a = m_array.load(std::memory_order_acquire);
+        T item = a->get(t);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // lost the race to the owner or another thief
+        return item;
+    }
+
+    bool empty() const
+    {
+        auto t = m_top.load(std::memory_order_acquire);
+        auto b = m_bottom.load(std::memory_order_acquire);
+        return b <= t;
+    }
+
+private:
+    struct Array
+    {
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+        Array *retired; // previous, smaller array
+
+        explicit Array(size_t cap) : capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap]), retired(nullptr)
+        {
+            if ((cap & (cap - 1)) != 0)
+                throw std::invalid_argument("WorkStealingDeque capacity must be power of two");
+        }
+
+        ~Array()
+        {
+            delete retired;
+        }
+
+        T get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T item) { slots[i & mask].store(item, std::memory_order_relaxed); }
+    };
+
+    Array *grow(Array *old, int64_t t, int64_t b)
+    {
+        Array *bigger = new Array(old->capacity * 2);
+        for (auto i = t; i < b; i++)
+            bigger->put(i, old->get(i));
+        bigger->retired = old;
+        m_array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> m_top;    // thieves
+    alignas(64) std::atomic<int64_t> m_bottom; // owner
+    std::atomic<Array *> m_array;
+};
+
+// ================== Move-only task with inline storage =====================
+// A std::function replacement for the pool. Callables up to one cache line are
+// stored inline, so wrapping a typical lambda never touches the heap; bigger
+// ones fall back to a heap allocation. Being move-only it can also hold
+// move-only captures (unique_ptr, promises, ...) which std::function can't.
+class InlineTask
+{
+public:
+    static constexpr size_t kInlineSize = 64;
+
+    InlineTask() noexcept : m_ops(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InlineTask>>>
+    InlineTask(F &&f) : m_ops(nullptr)
+    {
+        emplace(std::forward<F>(f));
+    }
+
+    ~InlineTask()
+    {
+        reset();
+    }
+
+    InlineTask(const InlineTask &) = delete;
+    InlineTask &operator=(const InlineTask &) = delete;
+
+    InlineTask(InlineTask &&other) noexcept : m_ops(other.m_ops)
+    {
+        if (m_ops)
+        {
+            m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    InlineTask &operator=(InlineTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            m_ops = other.m_ops;
+            if (m_ops)
+            {
+                m_ops->move(m_storage, other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    template <typename F>
+    void emplace(F &&f)
+    {
+        using Fn = std::decay_t<F>;
+        reset();
+        if constexpr (fits_inline<Fn>())
+        {
+            new (m_storage) Fn(std::forward<F>(f));
+            m_ops = &inline_ops<Fn>;
+        }
+        else
+        {
+            *reinterpret_cast<Fn **>(m_storage) = new Fn(std::forward<F>(f));
+            m_ops = &heap_ops<Fn>;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    void operator()()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_ops != nullptr;
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src) noexcept;
+        void (*destroy)(void *) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr bool fits_inline()
+    {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template <typename Fn>
+    static constexpr Ops inline_ops = {
+        [](void *p)
+        { (*static_cast<Fn *>(p))(); },
+        [](void *dst, void *src) noexcept
+        {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        },
+        [](void *p) noexcept
+        { static_cast<Fn *>(p)->~Fn(); },
+    };
+
+    template <typename Fn>
+    static constexpr Ops heap_ops = {
+        [](void *p)
+        { (**static_cast<Fn **>(p))(); },
+        [](void *dst, void *src) noexcept
+        { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); },
+        [](void *p) noexcept
+        { delete *static_cast<Fn **>(p); },
+    };
+
+    alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+    const Ops *m_ops;
+};
+
+// ================== Pool-backed task nodes =====================
+// Queue entries for the ThreadPool. Nodes are carved out of slabs and recycled
+// through a per-thread free list, so in steady state taking and returning a
+// node is a couple of pointer swaps. A thread whose cache runs dry (typically
+// an external submitter) grabs a whole batch from the shared pool, a thread
+// whose cache overflows (typically a worker) hands a batch back, so the shared
+// mutex is only touched once every kBatchSize nodes.
+//
+// Nodes are never freed back to the heap, so taking one allocates nothing as
+// long as no more tasks are in flight than the pool has already held at once.
+// Past that high-water mark it allocates a slab as large as everything it
+// holds so far, doubling its capacity, so a pool warmed with N tasks in
+// flight takes up to the next power of two above N before it allocates
+// again, and a bigger burst costs O(log) slabs rather than one per batch.
+struct TaskNode
+{
+    TaskNode *next = nullptr;
+    InlineTask task;
+    std::chrono::steady_clock::time_point deadline;   // max() when the task has none
+    std::chrono::steady_clock::time_point enqueuedAt; // zero unless instrumented
+    uint64_t seq = 0;                                 // FIFO tie-break inside a lane
+};
+
+class TaskNodePool
+{
+public:
+    static constexpr size_t kBatchSize = 256;
+
+    static TaskNodePool &getInstance()
+    {
+        static TaskNodePool instance;
+        return instance;
+    }
+
+    TaskNode *acquire()
+    {
+        auto &cache = local_cache();
+        if (!cache.head)
+            refill(cache);
+
+        TaskNode *node = cache.head;
+        cache.head = node->next;
+        cache.count--;
+        node->next = nullptr;
+        return node;
+    }
+
+    void release(TaskNode *node)
+    {
+        node->task.reset();
+
+        auto &cache = local_cache();
+        node->next = cache.head;
+        cache.head = node;
+        if (++cache.count >= 2 * kBatchSize)
+            spill(cache, kBatchSize);
+    }
+
+    // Nodes allocated so far, an upper bound on the tasks in flight.
+    size_t capacity() const
+    {
+        return m_capacity.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct LocalCache
+    {
+        TaskNode *head = nullptr;
+        size_t count = 0;
+
+        ~LocalCache()
+        {
+            if (head)
+                TaskNodePool::getInstance().spill(*this, count);
+        }
+    };
+
+    struct Batch
+    {
+        TaskNode *head;
+        size_t count;
+    };
+
+    TaskNodePool() = default;
+
+    void refill(LocalCache &cache)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_batches.empty())
+        {
+            // only reached past the high-water mark of tasks in flight
+            size_t nodes = std::max(kBatchSize, m_capacity.load(std::memory_order_relaxed));
+            m_slabs.emplace_back(new TaskNode[nodes]);
+            m_capacity.fetch_add(nodes, std::memory_order_relaxed);
+            TaskNode *slab = m_slabs.back().get();
+            for (size_t first = 0; first < nodes; first += kBatchSize)
+            {
+                for (size_t i = first; i + 1 < first + kBatchSize; i++)
+                    slab[i].next = &slab[i + 1];
+                slab[first + kBatchSize - 1].next = nullptr;
+                m_batches.push_back({&slab[first], kBatchSize});
+            }
+        }
+        auto batch = m_batches.back();
+        m_batches.pop_back();
+        cache.head = batch.head;
+        cache.count = batch.count;
+    }
+
+    void spill(LocalCache &cache, size_t n)
+    {
+        TaskNode *head = cache.head;
+        TaskNode *tail = head;
+        for (size_t i = 1; i < n; i++)
+            tail = tail->next;
+        cache.head = tail->next;
+        cache.count -= n;
+        tail->next = nullptr;
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_batches.push_back({head, n});
+    }
+
+    static LocalCache &local_cache()
+    {
+        static thread_local LocalCache cache;
+        return cache;
+    }
+
+    std::mutex m_mutex;
+    std::vector<Batch> m_batches;
+    std::vector<std::unique_ptr<TaskNode[]>> m_slabs;
+    std::atomic<size_t> m_capacity{0}; // nodes in all slabs
+};
+
+template <typename T>
+class TaskFuture;
+
+// ================== Priority lanes =====================
+// Tasks submitted with an explicit priority or a deadline, and every task
+// submitted from outside the pool, wait in one lane per priority. Inside a
+// lane tasks are ordered earliest deadline first, tasks without a deadline
+// after all that have one, in submission order.
+enum class Priority
+{
+    High,
+    Normal,
+    Low,
+};
+
+constexpr size_t kNumPriorities = 3;
+
+struct LaneStats
+{
+    size_t depth;          // tasks waiting right now
+    size_t maxDepth;       // high-water mark of depth
+    uint64_t submitted;    // tasks ever queued in the lane
+    uint64_t executed;     // tasks taken out of the lane
+    uint64_t deadlineMiss; // tasks started after their deadline
+    uint64_t promoted;     // tasks run ahead of higher lanes to avoid starvation or a deadline miss
+};
+
+class TaskLane
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void push(TaskNode *node)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            node->seq = m_nextSeq++;
+            // every queued task holds a node, so once the heap has room for
+            // all of them it only grows when the node pool does
+            if (m_heap.size() == m_heap.capacity())
+                m_heap.reserve(std::max(2 * m_heap.size(), TaskNodePool::getInstance().capacity()));
+            m_heap.push_back(node);
+            std::push_heap(m_heap.begin(), m_heap.end(), later);
+            m_earliest.store(m_heap.front()->deadline.time_since_epoch().count(), std::memory_order_relaxed);
+            // counted under the lock, or a pop could uncount the node first
+            // and wrap the depth below zero
+            auto depth = m_depth.load(std::memory_order_relaxed) + 1;
+            m_depth.store(depth, std::memory_order_relaxed);
+            if (depth > m_maxDepth.load(std::memory_order_relaxed))
+                m_maxDepth.store(depth, std::memory_order_relaxed);
+        }
+        m_submitted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    TaskNode *pop()
+    {
+        if (empty())
+            return nullptr;
+
+        TaskNode *node;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (m_heap.empty())
+                return nullptr;
+            std::pop_heap(m_heap.begin(), m_heap.end(), later);
+            node = m_heap.back();
+            m_heap.pop_back();
+            m_earliest.store(m_heap.empty() ? kNoDeadline : m_heap.front()->deadline.time_since_epoch().count(),
+                             std::memory_order_relaxed);
+            m_depth.store(m_depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        m_executed.fetch_add(1, std::memory_order_relaxed);
+        if (node->deadline != Clock::time_point::max() && Clock::now() > node->deadline)
+            m_deadlineMiss.fetch_add(1, std::memory_order_relaxed);
+        return node;
+    }
+
+    bool empty() const
+    {
+        return m_depth.load(std::memory_order_relaxed) == 0;
+    }
+
+    // True if the most urgent task in the lane is due by `now`.
+    bool due(Clock::time_point now) const
+    {
+        auto earliest = m_earliest.load(std::memory_order_relaxed);
+        return earliest != kNoDeadline && earliest <= now.time_since_epoch().count();
+    }
+
+    bool has_deadlines() const
+    {
+        return m_earliest.load(std::memory_order_relaxed) != kNoDeadline;
+    }
+
+    void count_promotion()
+    {
+        m_promoted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    LaneStats stats() const
+    {
+        return {m_depth.load(std::memory_order_relaxed), m_maxDepth.load(std::memory_order_relaxed),
+                m_submitted.load(std::memory_order_relaxed), m_executed.load(std::memory_order_relaxed),
+                m_deadlineMiss.load(std::memory_order_relaxed), m_promoted.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr Clock::rep kNoDeadline = Clock::time_point::max().time_since_epoch().count();
+
+    // heap comparator: true if a should run after b
+    static bool later(const TaskNode *a, const TaskNode *b)
+    {
+        if (a->deadline != b->deadline)
+            return a->deadline > b->deadline;
+        return a->seq > b->seq;
+    }
+
+    std::mutex m_mutex;
+    std::vector<TaskNode *> m_heap;
+    uint64_t m_nextSeq = 0;
+    std::atomic<Clock::rep> m_earliest{kNoDeadline};
+
+    alignas(64) std::atomic<size_t> m_depth{0};
+    std::atomic<size_t> m_maxDepth{0};
+    std::atomic<uint64_t> m_submitted{0};
+    std::atomic<uint64_t> m_executed{0};
+    std::atomic<uint64_t> m_deadlineMiss{0};
+    std::atomic<uint64_t> m_promoted{0};
+};
+
+// ================== CPU affinity =====================
+// CPUs listed in /sys/devices/system/node/nodeN/cpulist, e.g. "0-3,8-11".
+// Empty if the node does not exist or the system has no NUMA information.
+inline std::vector<int> numa_node_cpus(int node)
+{
+    std::vector<int> cpus;
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string range;
+    while (std::getline(file, range, ','))
+    {
+        try
+        {
+            auto dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        catch (const std::exception &)
+        {
+            break;
+        }
+    }
+    return cpus;
+}
+
+// Restricts the calling thread to `cpus`. Returns false if that is not
+// supported or none of the CPUs can be used.
+inline bool pin_current_thread(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// ================== Pool options =====================
+// The pool keeps between minThreads and maxThreads workers. It adds a worker
+// when tasks pile up in the lanes (more than growThreshold per live worker)
+// and nobody is asleep to take them, and a worker that found nothing to do
+// for idleTimeout retires. minThreads is at least 1.
+// Pinning is best effort: with `cpus` set, the worker in slot i is pinned to
+// cpus[i % cpus.size()], otherwise with numaNode >= 0 every worker is
+// restricted to that node's CPUs.
+struct ThreadPoolOptions
+{
+    int minThreads = 1;
+    int maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+    std::chrono::milliseconds idleTimeout{1000};
+    size_t growThreshold = 4;
+    std::vector<int> cpus;
+    int numaNode = -1;
+    bool instrument = true; // per-worker counters and latency histograms
+    unsigned sampleEvery = 16; // time one in this many tasks per submitting thread, rounded up to a power of two
+};
+
+// ================== Instrumentation =====================
+// Every counter below has a single writer (the worker owning it), so updates
+// are a relaxed load and store on a cache line nobody else writes, never a
+// locked RMW. Readers merge them on demand into a PoolSnapshot.
+inline void bump(std::atomic<uint64_t> &counter, uint64_t delta = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+struct HistogramSnapshot
+{
+    static constexpr size_t kBuckets = 64;
+
+    // bucket b counts samples in [2^(b-1), 2^b) ns, bucket 0 counts zeros
+    std::array<uint64_t, kBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sumNs = 0;
+
+    static uint64_t upper_bound(size_t bucket)
+    {
+        return bucket >= 63 ? std::numeric_limits<uint64_t>::max() : uint64_t{1} << bucket;
+    }
+
+    // Upper bound of the bucket holding the q-quantile, q in [0, 1].
+    uint64_t percentile(double q) const
+    {
+        if (count == 0)
+            return 0;
+        auto rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; b++)
+        {
+            seen += buckets[b];
+            if (seen >= rank)
+                return upper_bound(b);
+        }
+        return upper_bound(kBuckets - 1);
+    }
+
+    double mean() const
+    {
+        return count ? static_cast<double>(sumNs) / count : 0.0;
+    }
+
+    void merge(const HistogramSnapshot &other)
+    {
+        for (size_t b = 0; b < kBuckets; b++)
+            buckets[b] += other.buckets[b];
+        count += other.count;
+        sumNs += other.sumNs;
+    }
+};
+
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::steady_clock::duration d)
+    {
+        auto ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), 0));
+        size_t bucket = std::min<size_t>(std::bit_width(ns), HistogramSnapshot::kBuckets - 1);
+        bump(m_buckets[bucket]);
+        bump(m_sumNs, ns);
+    }
+
+    HistogramSnapshot snapshot() const
+    {
+        HistogramSnapshot snap;
+        for (size_t b = 0; b < HistogramSnapshot::kBuckets; b++)
+        {
+            snap.buckets[b] = m_buckets[b].load(std::memory_order_relaxed);
+            snap.count += snap.buckets[b];
+        }
+        snap.sumNs = m_sumNs.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::kBuckets> m_buckets{};
+    std::atomic<uint64_t> m_sumNs{0};
+};
+
+struct WorkerStats
+{
+    std::atomic<uint64_t> tasks{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> busyNs{0}; // estimated from the sampled tasks
+    std::atomic<uint64_t> idleNs{0}; // time spent asleep waiting for work
+    LatencyHistogram queueWait;      // enqueue -> start, sampled tasks only
+    LatencyHistogram runTime;        // start -> finish, sampled tasks only
+};
+
+struct WorkerSnapshot
+{
+    size_t index;
+    bool live;
+    uint64_t tasks;
+    uint64_t steals;
+    double busySeconds;
+    double idleSeconds;
+
+    double utilization() const
+    {
+        double total = busySeconds + idleSeconds;
+        return total > 0 ? busySeconds / total : 0.0;
+    }
+};
+
+struct PoolSnapshot
+{
+    double uptimeSeconds = 0;
+    std::vector<WorkerSnapshot> workers;
+    HistogramSnapshot queueWait;
+    HistogramSnapshot runTime;
+    std::array<LaneStats, kNumPriorities> lanes{};
+
+    std::string to_text() const
+    {
+        std::ostringstream out;
+        out << "uptime " << uptimeSeconds << "s, " << workers.size() << " worker slots\n";
+        out << "worker  live  tasks      steals     busy(s)    idle(s)    util\n";
+        for (auto &w : workers)
+        {
+            out << w.index << "\t" << (w.live ? "yes" : "no") << "\t" << w.tasks << "\t" << w.steals << "\t"
+                << w.busySeconds << "\t" << w.idleSeconds << "\t" << w.utilization() * 100 << "%\n";
+        }
+        print_histogram(out, "queue wait", queueWait);
+        print_histogram(out, "run time", runTime);
+        static const char *names[] = {"high", "normal", "low"};
+        for (size_t p = 0; p < kNumPriorities; p++)
+        {
+            out << "lane " << names[p] << ": depth " << lanes[p].depth << " (max " << lanes[p].maxDepth
+                << "), executed " << lanes[p].executed << ", deadline misses " << lanes[p].deadlineMiss
+                << ", promoted " << lanes[p].promoted << "\n";
+        }
+        return out.str();
+    }
+
+    std::string to_json() const
+    {
+        std::ostringstream out;
+        out << "{\"uptime_s\":" << uptimeSeconds << ",\"workers\":[";
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            auto &w = workers[i];
+            out << (i ? "," : "") << "{\"index\":" << w.index << ",\"live\":" << (w.live ? "true" : "false")
+                << ",\"tasks\":" << w.tasks << ",\"steals\":" << w.steals << ",\"busy_s\":" << w.busySeconds
+                << ",\"idle_s\":" << w.idleSeconds << ",\"utilization\":" << w.utilization() << "}";
+        }
+        out << "],\"queue_wait_ns\":";
+        json_histogram(out, queueWait);
+        out << ",\"run_time_ns\":";
+        json_histogram(out, runTime);
+        out << ",\"lanes\":[";
+        for (size_t p = 0; p < kNumPriorities; p++)
+        {
+            out << (p ? "," : "") << "{\"depth\":" << lanes[p].depth << ",\"max_depth\":" << lanes[p].maxDepth
+                << ",\"submitted\":" << lanes[p].submitted << ",\"executed\":" << lanes[p].executed
+                << ",\"deadline_miss\":" << lanes[p].deadlineMiss << ",\"promoted\":" << lanes[p].promoted << "}";
+        }
+        out << "]}";
+        return out.str();
+    }
+
+private:
+    static void print_histogram(std::ostringstream &out, const char *name, const HistogramSnapshot &h)
+    {
+        out << name << ": n=" << h.count << " mean=" << h.mean() << "ns p50<=" << h.percentile(0.5)
+            << "ns p90<=" << h.percentile(0.9) << "ns p99<=" << h.percentile(0.99) << "ns max<="
+            << h.percentile(1.0) << "ns\n";
+    }
+
+    static void json_histogram(std::ostringstream &out, const HistogramSnapshot &h)
+    {
+        out << "{\"count\":" << h.count << ",\"mean\":" << h.mean() << ",\"p50\":" << h.percentile(0.5)
+            << ",\"p90\":" << h.percentile(0.9) << ",\"p99\":" << h.percentile(0.99) << ",\"buckets\":[";
+        bool first = true;
+        for (size_t b = 0; b < HistogramSnapshot::kBuckets; b++)
+        {
+            if (!h.buckets[b])
+                continue;
+            out << (first ? "" : ",") << "[" << HistogramSnapshot::upper_bound(b) << "," << h.buckets[b] << "]";
+            first = false;
+        }
+        out << "]}";
+    }
+};
+
+// ================== Work-stealing ThreadPool =====================
+// Every worker owns a WorkStealingDeque. Normal priority tasks submitted from
+// inside the pool land on the submitting worker's own deque, everything else
+// goes to the TaskLane of its priority, which doubles as the injection queue.
+// A worker looks at the High lane, its own deque, the Normal and Low lanes and
+// finally steals from its siblings before going to sleep. So bulk work cannot
+// starve the lower lanes, a worker that has passed over a non-empty lane
+// kStarvationLimit times serves it next, and a lane whose most urgent deadline
+// has arrived is served ahead of everything else.
+// Tasks travel as pooled TaskNodes, so submitting a task that fits an
+// InlineTask does not allocate once the node pool is warm.
+// Worker slots (deque plus thread) are allocated for maxThreads up front, so
+// thieves can scan them while workers come and go.
+class ThreadPool
+{
+public:
+    using Task = InlineTask;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr unsigned kStarvationLimit = 16;
+
+    ThreadPool(int n = std::thread::hardware_concurrency())
+        : ThreadPool(fixed_size(n))
+    {
+    }
+
+    explicit ThreadPool(const ThreadPoolOptions &options)
+        : m_minThreads(std::max(options.minThreads, 1)),
+          m_maxThreads(std::max(options.maxThreads, m_minThreads)),
+          m_idleTimeout(options.idleTimeout),
+          m_growThreshold(std::max<size_t>(options.growThreshold, 1)),
+          m_active(true),
+          m_instrument(options.instrument),
+          m_sampleEvery(std::bit_ceil(std::max(options.sampleEvery, 1u))),
+          m_startTime(Clock::now()),
+          m_slots(new WorkerSlot[m_maxThreads]),
+          m_numSlots(0)
+    {
+        if (!options.cpus.empty())
+        {
+            for (int i = 0; i < m_maxThreads; i++)
+                m_slots[i].cpus = {options.cpus[i % options.cpus.size()]};
+        }
+        else if (options.numaNode >= 0)
+        {
+            auto cpus = numa_node_cpus(options.numaNode);
+            for (int i = 0; i < m_maxThreads; i++)
+                m_slots[i].cpus = cpus;
+        }
+
+        for (int i = 0; i < m_minThreads; i++)
+            this->add_worker();
+    }
+
+    ~ThreadPool()
+    {
+        this->shutdown();
+    }
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_active = false;
+        }
+        m_conditionVar.notify_all();
+
+        std::lock_guard<std::mutex> guard(m_resizeMutex);
+        for (int i = 0; i < m_maxThreads; i++)
+        {
+            if (m_slots[i].thread.joinable())
+                m_slots[i].thread.join();
+        }
+    }
+
+    template <typename F>
+    void submit_task(F &&task)
+    {
+        TaskNode *node = make_node(std::forward<F>(task), Clock::time_point::max());
+        if (t_currentPool == this)
+            m_slots[t_workerIndex].queue.push(node);
+        else
+            lane(Priority::Normal).push(node);
+        wake_one();
+    }
+
+    template <typename F>
+    void submit_task(F &&task, Priority priority)
+    {
+        submit_task(std::forward<F>(task), priority, Clock::time_point::max());
+    }
+
+    // The deadline only orders tasks inside their lane and lets an overdue
+    // lane jump the queue, tasks are never dropped for missing it.
+    template <typename F>
+    void submit_task(F &&task, Priority priority, Clock::time_point deadline)
+    {
+        lane(priority).push(make_node(std::forward<F>(task), deadline));
+        wake_one();
+    }
+
+    LaneStats lane_stats(Priority priority) const
+    {
+        return m_lanes[static_cast<size_t>(priority)].stats();
+    }
+
+    // Timing costs three clock reads per sampled task (see sampleEvery); task
+    // and steal counts are exact and kept either way. Busy time is scaled up
+    // from the sampled tasks.
+    void set_instrumentation(bool enabled)
+    {
+        m_instrument.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Merges every worker's counters, including retired ones, into one view.
+    PoolSnapshot snapshot() const
+    {
+        PoolSnapshot snap;
+        snap.uptimeSeconds = std::chrono::duration<double>(Clock::now() - m_startTime).count();
+        auto n = m_numSlots.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++)
+        {
+            const WorkerStats &stats = m_slots[i].stats;
+            snap.workers.push_back({i, m_slots[i].live.load(std::memory_order_relaxed),
+                                    stats.tasks.load(std::memory_order_relaxed),
+                                    stats.steals.load(std::memory_order_relaxed),
+                                    stats.busyNs.load(std::memory_order_relaxed) / 1e9,
+                                    stats.idleNs.load(std::memory_order_relaxed) / 1e9});
+            snap.queueWait.merge(stats.queueWait.snapshot());
+            snap.runTime.merge(stats.runTime.snapshot());
+        }
+        for (size_t p = 0; p < kNumPriorities; p++)
+            snap.lanes[p] = m_lanes[p].stats();
+        return snap;
+    }
+
+    // Runs f(args...) on the pool and returns a future for its result.
+    // Exceptions thrown by f are rethrown from TaskFuture::get().
+    template <typename F, typename... Args>
+    auto submit(F &&f, Args &&...args) -> TaskFuture<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>;
+
+    // Workers currently alive; changes over time for an elastic pool.
+    size_t num_workers() const
+    {
+        return m_liveWorkers.load(std::memory_order_acquire);
+    }
+
+    // The pool the calling thread works for, nullptr outside of any pool.
+    static ThreadPool *current()
+    {
+        return t_currentPool;
+    }
+
+    // Lets a worker that is waiting on something run one queued task instead
+    // of blocking. Returns false if nothing was runnable or the caller is not
+    // one of this pool's workers.
+    bool run_pending_task()
+    {
+        if (t_currentPool != this)
+            return false;
+        TaskNode *node = find_task(t_workerIndex);
+        if (!node)
+            return false;
+        run_node(m_slots[t_workerIndex], node);
+        return true;
+    }
+
+    void add_worker()
+    {
+        std::lock_guard<std::mutex> guard(m_resizeMutex);
+        if (!spawn_worker())
+            throw std::runtime_error("ThreadPool: no free worker slot");
+    }
+
+private:
+    static ThreadPoolOptions fixed_size(int n)
+    {
+        ThreadPoolOptions options;
+        options.minThreads = n;
+        options.maxThreads = n;
+        return options;
+    }
+
+    struct WorkerSlot
+    {
+        WorkStealingDeque<TaskNode *> queue;
+        unsigned passedOver[kNumPriorities] = {}; // owner only
+        std::vector<int> cpus;                     // affinity, empty for none
+        std::thread thread;                        // guarded by m_resizeMutex
+        std::atomic<bool> live{false};
+        WorkerStats stats;
+    };
+
+    // Starts a worker in the first free slot. Caller holds m_resizeMutex.
+    bool spawn_worker()
+    {
+        int index = 0;
+        while (index < m_maxThreads && m_slots[index].live.load(std::memory_order_acquire))
+            index++;
+        if (index == m_maxThreads)
+            return false;
+
+        WorkerSlot &slot = m_slots[index];
+        if (slot.thread.joinable())
+            slot.thread.join(); // a retired worker that may still be on its way out
+
+        slot.live.store(true, std::memory_order_relaxed);
+        m_liveWorkers.fetch_add(1, std::memory_order_release);
+        // publish the slot before the thread can be seen by thieves
+        if (static_cast<size_t>(index) >= m_numSlots.load(std::memory_order_relaxed))
+            m_numSlots.store(index + 1, std::memory_order_release);
+        slot.thread = std::thread([this, index]
+                                  { this->worker_loop(index); });
+        return true;
+    }
+
+    // Called from submitters when no worker is asleep.
+    void maybe_grow()
+    {
+        auto live = m_liveWorkers.load(std::memory_order_relaxed);
+        if (live >= static_cast<size_t>(m_maxThreads))
+            return;
+
+        size_t queued = 0;
+        for (auto &l : m_lanes)
+            queued += l.stats().depth;
+        if (queued < m_growThreshold * live)
+            return;
+
+        // never make a submitter wait for another one that is already growing
+        std::unique_lock<std::mutex> lock(m_resizeMutex, std::try_to_lock);
+        if (lock && m_active)
+            spawn_worker();
+    }
+
+    // An idle worker leaves unless that would take the pool below minThreads.
+    bool try_retire(size_t index)
+    {
+        auto live = m_liveWorkers.load(std::memory_order_relaxed);
+        do
+        {
+            if (live <= static_cast<size_t>(m_minThreads))
+                return false;
+        } while (!m_liveWorkers.compare_exchange_weak(live, live - 1, std::memory_order_acq_rel));
+
+        m_slots[index].live.store(false, std::memory_order_release);
+        return true;
+    }
+
+    template <typename F>
+    TaskNode *make_node(F &&task, Clock::time_point deadline)
+    {
+        TaskNode *node = TaskNodePool::getInstance().acquire();
+        if constexpr (std::is_same_v<std::decay_t<F>, Task>)
+            node->task = std::move(task);
+        else
+            node->task.emplace(std::forward<F>(task));
+        node->deadline = deadline;
+        bool sample = m_instrument.load(std::memory_order_relaxed) && (++t_sampleCounter & (m_sampleEvery - 1)) == 0;
+        node->enqueuedAt = sample ? Clock::now() : Clock::time_point();
+        return node;
+    }
+
+    void run_node(WorkerSlot &slot, TaskNode *node)
+    {
+        bump(slot.stats.tasks);
+        if (node->enqueuedAt == Clock::time_point())
+        {
+            node->task();
+        }
+        else
+        {
+            auto start = Clock::now();
+            slot.stats.queueWait.record(start - node->enqueuedAt);
+            node->task();
+            auto elapsed = Clock::now() - start;
+            slot.stats.runTime.record(elapsed);
+            bump(slot.stats.busyNs, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() * m_sampleEvery);
+        }
+        TaskNodePool::getInstance().release(node);
+    }
+
+    TaskLane &lane(Priority priority)
+    {
+        return m_lanes[static_cast<size_t>(priority)];
+    }
+
+    void worker_loop(size_t index)
+    {
+        t_currentPool = this;
+        t_workerIndex = index;
+        if (!m_slots[index].cpus.empty())
+            pin_current_thread(m_slots[index].cpus);
+
+        while (true)
+        {
+            TaskNode *node = find_task(index);
+            if (node)
+            {
+                run_node(m_slots[index], node);
+                continue;
+            }
+
+            bool instrument = m_instrument.load(std::memory_order_relaxed);
+            auto idleStart = instrument ? Clock::now() : Clock::time_point();
+            bool keepRunning = wait_for_work(index);
+            if (instrument)
+                bump(m_slots[index].stats.idleNs,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - idleStart).count());
+            if (!keepRunning)
+                break;
+        }
+
+        t_currentPool = nullptr;
+    }
+
+    TaskNode *find_task(size_t index)
+    {
+        WorkerSlot &slot = m_slots[index];
+
+        // lower lanes that are starving or overdue go first
+        bool deadlines = false;
+        for (size_t p = kNumPriorities; p-- > 1;)
+            deadlines |= m_lanes[p].has_deadlines();
+        auto now = deadlines ? Clock::now() : Clock::time_point::min();
+        for (size_t p = kNumPriorities; p-- > 1;)
+        {
+            TaskLane &l = m_lanes[p];
+            if (l.empty() || (slot.passedOver[p] < kStarvationLimit && !l.due(now)))
+                continue;
+            if (TaskNode *node = l.pop())
+            {
+                l.count_promotion();
+                slot.passedOver[p] = 0;
+                return node;
+            }
+        }
+
+        // regular order: High lane, own deque, Normal and Low lanes
+        TaskNode *node = m_lanes[0].pop();
+        size_t served = 0;
+        if (!node && (node = slot.queue.pop()))
+            served = static_cast<size_t>(Priority::Normal);
+        for (size_t p = 1; !node && p < kNumPriorities; p++)
+        {
+            node = m_lanes[p].pop();
+            served = p;
+        }
+        if (node)
+        {
+            passed_over(slot, served);
+            return node;
+        }
+
+        auto n = m_numSlots.load(std::memory_order_acquire);
+        for (size_t i = 1; i < n; i++)
+        {
+            if ((node = m_slots[(index + i) % n].queue.steal()))
+            {
+                bump(slot.stats.steals);
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    // Records that a task from lane `served` ran while lower lanes were waiting.
+    void passed_over(WorkerSlot &slot, size_t served)
+    {
+        slot.passedOver[served] = 0;
+        for (size_t p = served + 1; p < kNumPriorities; p++)
+        {
+            if (!m_lanes[p].empty())
+                slot.passedOver[p]++;
+        }
+    }
+
+    bool has_work() const
+    {
+        for (auto &l : m_lanes)
+        {
+            if (!l.empty())
+                return true;
+        }
+        auto n = m_numSlots.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!m_slots[i].queue.empty())
+                return true;
+        }
+        return false;
+    }
+
+    // Returns false when the worker should exit: the pool is shut down and
+    // there is nothing left to run, or the worker idled out and retired.
+    bool wait_for_work(size_t index)
+    {
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool work = has_work();
+        while (!work && m_active)
+        {
+            if (m_minThreads == m_maxThreads)
+            {
+                m_conditionVar.wait(lock);
+            }
+            else if (m_conditionVar.wait_for(lock, m_idleTimeout) == std::cv_status::timeout &&
+                     !has_work() && try_retire(index))
+            {
+                break;
+            }
+            work = has_work();
+        }
+
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        return work;
+    }
+
+    void wake_one()
+    {
+        // pairs with the fence in wait_for_work(): either the sleeper sees our
+        // task or we see the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) == 0)
+        {
+            if (m_minThreads != m_maxThreads)
+                maybe_grow();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_conditionVar.notify_one();
+    }
+
+    int m_minThreads;
+    int m_maxThreads;
+    std::chrono::milliseconds m_idleTimeout;
+    size_t m_growThreshold;
+    std::atomic<bool> m_active;
+    std::atomic<bool> m_instrument;
+    unsigned m_sampleEvery;
+    Clock::time_point m_startTime;
+
+    std::unique_ptr<WorkerSlot[]> m_slots;
+    std::atomic<size_t> m_numSlots; // slots ever used, thieves scan this many
+    std::atomic<size_t> m_liveWorkers{0};
+    std::mutex m_resizeMutex;
+
+    TaskLane m_lanes[kNumPriorities];
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_conditionVar;
+    std::atomic<int> m_sleepers{0};
+
+    static inline thread_local ThreadPool *t_currentPool = nullptr;
+    static inline thread_local size_t t_workerIndex = 0;
+    static inline thread_local unsigned t_sampleCounter = 0;
+};
+
+// ================== Futures =====================
+// Result slot shared between a submitted task and its TaskFuture. It is
+// reference counted by hand (one reference each) and the ready flag doubles
+// as the futex word, so a waiter sleeps in the kernel without a mutex or a
+// condition variable.
+template <typename T>
+class FutureState
+{
+public:
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template <typename... V>
+    void set_value(V &&...value)
+    {
+        m_value.emplace(std::forward<V>(value)...);
+        publish();
+    }
+
+    void set_exception(std::exception_ptr error)
+    {
+        m_error = error;
+        publish();
+    }
+
+    bool ready() const
+    {
+        return m_ready.load(std::memory_order_acquire) != 0;
+    }
+
+    void wait() const
+    {
+        m_ready.wait(0, std::memory_order_acquire);
+    }
+
+    T take()
+    {
+        if (m_error)
+            std::rethrow_exception(m_error);
+        if constexpr (!std::is_void_v<T>)
+            return std::move(*m_value);
+    }
+
+    void retain()
+    {
+        m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+private:
+    void publish()
+    {
+        m_ready.store(1, std::memory_order_release);
+        m_ready.notify_all();
+    }
+
+    std::atomic<int> m_ready{0};
+    std::atomic<int> m_refs{1};
+    std::optional<Value> m_value;
+    std::exception_ptr m_error;
+};
+
+// Move-only handle to a FutureState. Waiting from inside the pool that runs
+// the task keeps the worker busy with other queued tasks, so a task can wait
+// on its own subtasks without deadlocking the pool.
+template <typename T>
+class TaskFuture
+{
+public:
+    TaskFuture() : m_state(nullptr), m_pool(nullptr) {}
+    TaskFuture(FutureState<T> *state, ThreadPool *pool) : m_state(state), m_pool(pool) {}
+
+    ~TaskFuture()
+    {
+        if (m_state)
+            m_state->release();
+    }
+
+    TaskFuture(const TaskFuture &) = delete;
+    TaskFuture &operator=(const TaskFuture &) = delete;
+
+    TaskFuture(TaskFuture &&other) noexcept : m_state(other.m_state), m_pool(other.m_pool)
+    {
+        other.m_state = nullptr;
+    }
+
+    TaskFuture &operator=(TaskFuture &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_state)
+                m_state->release();
+            m_state = other.m_state;
+            m_pool = other.m_pool;
+            other.m_state = nullptr;
+        }
+        return *this;
+    }
+
+    bool valid() const
+    {
+        return m_state != nullptr;
+    }
+
+    bool ready() const
+    {
+        return m_state->ready();
+    }
+
+    void wait() const
+    {
+        if (m_pool && ThreadPool::current() == m_pool)
+        {
+            while (!m_state->ready())
+            {
+                if (!m_pool->run_pending_task())
+                    std::this_thread::yield();
+            }
+            return;
+        }
+        m_state->wait();
+    }
+
+    // Waits for the task and returns its result; the future is empty afterwards.
+    T get()
+    {
+        wait();
+        FutureState<T> *state = m_state;
+        m_state = nullptr;
+        struct Release
+        {
+            FutureState<T> *state;
+            ~Release() { state->release(); }
+        } guard{state};
+        return state->take();
+    }
+
+private:
+    FutureState<T> *m_state;
+    ThreadPool *m_pool;
+};
+
+template <typename F, typename... Args>
+auto ThreadPool::submit(F &&f, Args &&...args) -> TaskFuture<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+{
+    using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+    auto *state = new FutureState<R>();
+    state->retain(); // one reference for the task, one for the future
+
+    submit_task([state, fn = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable
+                {
+                    try
+                    {
+                        if constexpr (std::is_void_v<R>)
+                        {
+                            std::invoke(std::move(fn), std::move(args)...);
+                            state->set_value();
+                        }
+                        else
+                        {
+                            state->set_value(std::invoke(std::move(fn), std::move(args)...));
+                        }
+                    }
+                    catch (...)
+                    {
+                        state->set_exception(std::current_exception());
+                    }
+                    state->release(); });
+
+    return TaskFuture<R>(state, this);
+}
+
+// ================== Task graph =====================
+// A DAG of tasks. Each node keeps a count of unfinished predecessors; the
+// predecessor that brings it to zero submits it, so a node is scheduled the
+// moment it becomes ready without polling and without a thread parked on it.
+// Once a node throws, its remaining dependents are skipped and the exception
+// is reported through the future returned by run(). The graph must outlive
+// the run and only one run may be in flight at a time; after it finishes the
+// graph can be run again.
+class TaskGraph
+{
+public:
+    using NodeId = size_t;
+
+    template <typename F>
+    NodeId add(F &&work)
+    {
+        auto node = std::make_unique<Node>();
+        node->work.emplace(std::forward<F>(work));
+        m_nodes.push_back(std::move(node));
+        return m_nodes.size() - 1;
+    }
+
+    // `after` will only start once `before` has finished.
+    void precede(NodeId before, NodeId after)
+    {
+        m_nodes.at(before)->successors.push_back(m_nodes.at(after).get());
+        m_nodes.at(after)->predecessors++;
+    }
+
+    TaskFuture<void> run(ThreadPool &pool)
+    {
+        m_pool = &pool;
+        m_failed.store(false, std::memory_order_relaxed);
+        m_error = nullptr;
+        m_remaining.store(m_nodes.size(), std::memory_order_relaxed);
+
+        m_done = new FutureState<void>();
+        m_done->retain();
+        TaskFuture<void> future(m_done, &pool);
+
+        if (m_nodes.empty())
+        {
+            finish();
+            return future;
+        }
+
+        for (auto &node : m_nodes)
+            node->pending.store(node->predecessors, std::memory_order_relaxed);
+        for (auto &node : m_nodes)
+        {
+            if (node->predecessors == 0)
+                schedule(node.get());
+        }
+        return future;
+    }
+
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+private:
+    struct Node
+    {
+        InlineTask work;
+        std::vector<Node *> successors;
+        int predecessors = 0;
+        std::atomic<int> pending{0};
+    };
+
+    void schedule(Node *node)
+    {
+        m_pool->submit_task([this, node]
+                            { this->execute(node); });
+    }
+
+    void execute(Node *node)
+    {
+        if (!m_failed.load(std::memory_order_acquire))
+        {
+            try
+            {
+                node->work();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(m_errorMutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+
+        for (Node *next : node->successors)
+        {
+            if (next->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                schedule(next);
+        }
+
+        if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            finish();
+    }
+
+    void finish()
+    {
+        FutureState<void> *done = m_done;
+        m_done = nullptr;
+        if (m_error)
+            done->set_exception(m_error);
+        else
+            done->set_value();
+        done->release();
+    }
+
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    ThreadPool *m_pool = nullptr;
+    FutureState<void> *m_done = nullptr;
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<bool> m_failed{false};
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
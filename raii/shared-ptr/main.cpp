@@ -1,90 +1,8 @@
 #include <iostream>
 
-using namespace std;
-
-template <typename T>
-class SharedPointer
-{
-public:
-    SharedPointer() : ptr(nullptr), ref_count(nullptr) {}
-    explicit SharedPointer(T *p) : ptr(p), ref_count(new atomic<int>(1)) {}
-
-    ~SharedPointer()
-    {
-        release();
-    };
-
-    SharedPointer(const SharedPointer &other) : ptr(other.ptr),
-                                                ref_count(other.ref_count)
-    {
-        if (ref_count)
-            ++(*ref_count);
-    }
-
-    SharedPointer(SharedPointer &&other) : ptr(other.ptr), ref_count(other.ref_count)
-    {
-        // no increment in the ref count
-        other.ptr = nullptr;
-        other.ref_count = nullptr;
-    }
-
-    SharedPointer &operator=(const SharedPointer &other)
-    {
-        if (this != &other)
-        {
-            release();
-            ptr = other.ptr;
-            ref_count = other.ref_count;
-            if (ref_count)
-                ++(*ref_count);
-        }
-        return *this;
-    }
-
-    SharedPointer &operator=(SharedPointer &&other)
-    {
-        if (this != &other)
-        {
-            release();
-            ptr = other.ptr;
-            ref_count = other.ref_count;
-            other.ptr = nullptr;
-            other.ref_count = nullptr;
-        }
-        return *this;
-    }
-
-    void release()
-    {
-        if (ref_count)
-        {
-            if (--(*ref_count) == 0)
-            {
-                delete ref_count;
-                delete ptr;
-            }
-        }
-    }
-
-    T &operator*()
-    {
-        return *ptr;
-    }
+#include "shared_ptr.h"
 
-    T *operator->()
-    {
-        return ptr;
-    }
-
-    int count()
-    {
-        return *ref_count;
-    }
-
-private:
-    atomic<int> *ref_count;
-    T *ptr;
-};
+using namespace std;
 
 int main()
 {
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T>
+class SharedPointer
+{
+public:
+    SharedPointer() : ref_count(nullptr), ptr(nullptr) {}
+    explicit SharedPointer(T *p) : ref_count(p ? new std::atomic<int>(1) : nullptr), ptr(p) {}
+
+    ~SharedPointer()
+    {
+        release();
+    };
+
+    SharedPointer(const SharedPointer &other) : ref_count(other.ref_count),
+                                                ptr(other.ptr)
+    {
+        // a new owner needs no ordering, it is handed the object by `other`
+        if (ref_count)
+            ref_count->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SharedPointer(SharedPointer &&other) noexcept : ref_count(other.ref_count), ptr(other.ptr)
+    {
+        // no increment in the ref count
+        other.ptr = nullptr;
+        other.ref_count = nullptr;
+    }
+
+    SharedPointer &operator=(const SharedPointer &other)
+    {
+        if (this != &other)
+        {
+            release();
+            ptr = other.ptr;
+            ref_count = other.ref_count;
+            if (ref_count)
+                ref_count->fetch_add(1, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    SharedPointer &operator=(SharedPointer &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            ptr = other.ptr;
+            ref_count = other.ref_count;
+            other.ptr = nullptr;
+            other.ref_count = nullptr;
+        }
+        return *this;
+    }
+
+    // Drops this owner's reference and leaves it empty.
+    void release()
+    {
+        if (ref_count)
+        {
+            // acq_rel: every other owner's use of the object happens before
+            // the last one deletes it
+            if (ref_count->fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete ref_count;
+                delete ptr;
+            }
+            ref_count = nullptr;
+            ptr = nullptr;
+        }
+    }
+
+    T &operator*() const
+    {
+        return *ptr;
+    }
+
+    T *operator->() const
+    {
+        return ptr;
+    }
+
+    T *get() const
+    {
+        return ptr;
+    }
+
+    explicit operator bool() const
+    {
+        return ptr != nullptr;
+    }
+
+    int count() const
+    {
+        return ref_count ? ref_count->load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    std::atomic<int> *ref_count;
+    T *ptr;
+};